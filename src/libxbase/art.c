@@ -0,0 +1,1306 @@
+/*
+ * art - Adaptive radix tree for binary keys.
+ *
+ * Inner nodes come in four sizes: Node4 and Node16 keep sorted key
+ * bytes next to their child pointers, Node48 maps a byte to one of 48
+ * slots through a 256-entry index and Node256 is indexed directly.
+ * A node grows to the next size when it is full and shrinks back once
+ * it is well below the smaller capacity, so that a delete followed by
+ * an insert does not bounce between two sizes.
+ *
+ * Single-child paths are collapsed into a node prefix.  Only the first
+ * ART_MAX_PREFIX bytes are stored in the node; the rest of a longer
+ * prefix is read back from any leaf below it.  Lookups skip it
+ * optimistically and compare the full key once they reach a leaf.
+ *
+ * A key may be a prefix of another key, so every inner node has one
+ * extra slot for the leaf whose key ends right after the node prefix.
+ * That leaf sorts before all children of the node.
+ *
+ * Leaves are linked in key order, which makes cursor stepping O(1) and
+ * lets lower_bound answer "nothing in this subtree" with the successor
+ * of the subtree maximum.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "xmalloc.h"
+#include "art.h"
+
+#define ART_NODE4   1
+#define ART_NODE16  2
+#define ART_NODE48  3
+#define ART_NODE256 4
+
+#define ART_MAX_PREFIX 10
+
+typedef struct art_leaf {
+    art_cursor_st cs;
+    struct art_leaf *prev, *next;
+    unsigned char kbuf[];
+} art_leaf;
+
+typedef struct art_node {
+    uint8_t type;
+    uint16_t nchild;
+    uint32_t plen;
+    unsigned char prefix[ART_MAX_PREFIX];
+    art_leaf *leaf; /* key ending right after the prefix */
+} art_node;
+
+typedef struct art_node4 {
+    art_node n;
+    unsigned char keys[4];
+    void *childs[4];
+} art_node4;
+
+typedef struct art_node16 {
+    art_node n;
+    unsigned char keys[16];
+    void *childs[16];
+} art_node16;
+
+typedef struct art_node48 {
+    art_node n;
+    unsigned char index[256]; /* slot + 1, 0 if empty */
+    void *childs[48];
+} art_node48;
+
+typedef struct art_node256 {
+    art_node n;
+    void *childs[256];
+} art_node256;
+
+struct art_st {
+    void *root;
+    art_leaf *first, *last;
+    uint32_t nelem;
+    uint32_t nbytes;
+    int flag;
+    art_data_free_func_t data_free;
+};
+
+/* child pointers are tagged: leaves have the low bit set */
+#define is_leaf(p) ((uintptr_t)(p) & 1)
+#define to_leaf(p) ((art_leaf *)((uintptr_t)(p) & ~(uintptr_t)1))
+#define from_leaf(l) ((void *)((uintptr_t)(l) | 1))
+
+#define leaf_key(l) ((const unsigned char *)(l)->cs.key)
+
+#ifdef _MSC_VER
+#define inline __inline
+#endif
+
+static const uint32_t node_sizes[] = {
+    0,
+    sizeof(art_node4),
+    sizeof(art_node16),
+    sizeof(art_node48),
+    sizeof(art_node256),
+};
+
+static art_node *node_new(art_st *t, int type)
+{
+    art_node *n = xmalloc0(node_sizes[type]);
+
+    n->type = type;
+    t->nbytes += node_sizes[type];
+    return n;
+}
+
+static void node_free(art_st *t, art_node *n)
+{
+    t->nbytes -= node_sizes[n->type];
+    free(n);
+}
+
+static void node_copy_header(art_node *dst, const art_node *src)
+{
+    dst->nchild = src->nchild;
+    dst->plen = src->plen;
+    dst->leaf = src->leaf;
+    memcpy(dst->prefix, src->prefix, ART_MAX_PREFIX);
+}
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+static int leaf_cmp(const art_leaf *l, const unsigned char *key, uint32_t ksize)
+{
+    uint32_t kmin = min_u32(l->cs.ksize, ksize);
+    int res;
+
+    if ((res = memcmp(l->cs.key, key, kmin)))
+        return res;
+
+    return (int)l->cs.ksize - (int)ksize;
+}
+
+static inline int leaf_matches(const art_leaf *l, const unsigned char *key, uint32_t ksize)
+{
+    return l->cs.ksize == ksize && memcmp(l->cs.key, key, ksize) == 0;
+}
+
+static void **find_child(art_node *n, unsigned char c)
+{
+    switch (n->type) {
+    case ART_NODE4: {
+        art_node4 *p = (art_node4 *)n;
+
+        for (int i = 0; i < n->nchild; i++) {
+            if (p->keys[i] == c)
+                return &p->childs[i];
+        }
+        break;
+    }
+    case ART_NODE16: {
+        art_node16 *p = (art_node16 *)n;
+#ifdef __SSE2__
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c), _mm_loadu_si128((const __m128i *)p->keys));
+        unsigned mask = (unsigned)_mm_movemask_epi8(cmp) & ((1u << n->nchild) - 1);
+
+        if (mask)
+            return &p->childs[__builtin_ctz(mask)];
+#else
+        for (int i = 0; i < n->nchild; i++) {
+            if (p->keys[i] == c)
+                return &p->childs[i];
+        }
+#endif
+        break;
+    }
+    case ART_NODE48: {
+        art_node48 *p = (art_node48 *)n;
+
+        if (p->index[c])
+            return &p->childs[p->index[c] - 1];
+        break;
+    }
+    case ART_NODE256: {
+        art_node256 *p = (art_node256 *)n;
+
+        if (p->childs[c])
+            return &p->childs[c];
+        break;
+    }
+    }
+
+    return NULL;
+}
+
+/* smallest child whose key byte is greater than c */
+static void *next_child(art_node *n, unsigned char c)
+{
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char *keys = n->type == ART_NODE4 ? ((art_node4 *)n)->keys : ((art_node16 *)n)->keys;
+        void **childs = n->type == ART_NODE4 ? ((art_node4 *)n)->childs : ((art_node16 *)n)->childs;
+
+        for (int i = 0; i < n->nchild; i++) {
+            if (keys[i] > c)
+                return childs[i];
+        }
+        break;
+    }
+    case ART_NODE48: {
+        art_node48 *p = (art_node48 *)n;
+
+        for (int i = c + 1; i < 256; i++) {
+            if (p->index[i])
+                return p->childs[p->index[i] - 1];
+        }
+        break;
+    }
+    case ART_NODE256: {
+        art_node256 *p = (art_node256 *)n;
+
+        for (int i = c + 1; i < 256; i++) {
+            if (p->childs[i])
+                return p->childs[i];
+        }
+        break;
+    }
+    }
+
+    return NULL;
+}
+
+static void *first_child(art_node *n)
+{
+    switch (n->type) {
+    case ART_NODE4:
+        return n->nchild ? ((art_node4 *)n)->childs[0] : NULL;
+    case ART_NODE16:
+        return n->nchild ? ((art_node16 *)n)->childs[0] : NULL;
+    case ART_NODE48:
+    case ART_NODE256: {
+        void **slot = find_child(n, 0);
+
+        return slot ? *slot : next_child(n, 0);
+    }
+    }
+
+    return NULL;
+}
+
+static void *last_child(art_node *n)
+{
+    switch (n->type) {
+    case ART_NODE4:
+        return n->nchild ? ((art_node4 *)n)->childs[n->nchild - 1] : NULL;
+    case ART_NODE16:
+        return n->nchild ? ((art_node16 *)n)->childs[n->nchild - 1] : NULL;
+    case ART_NODE48: {
+        art_node48 *p = (art_node48 *)n;
+
+        for (int i = 255; i >= 0; i--) {
+            if (p->index[i])
+                return p->childs[p->index[i] - 1];
+        }
+        break;
+    }
+    case ART_NODE256: {
+        art_node256 *p = (art_node256 *)n;
+
+        for (int i = 255; i >= 0; i--) {
+            if (p->childs[i])
+                return p->childs[i];
+        }
+        break;
+    }
+    }
+
+    return NULL;
+}
+
+static art_leaf *minimum(void *p)
+{
+    while (!is_leaf(p)) {
+        art_node *n = p;
+
+        if (n->leaf)
+            return n->leaf;
+        p = first_child(n);
+    }
+
+    return to_leaf(p);
+}
+
+static art_leaf *maximum(void *p)
+{
+    while (!is_leaf(p)) {
+        art_node *n = p;
+
+        if (n->nchild == 0)
+            return n->leaf;
+        p = last_child(n);
+    }
+
+    return to_leaf(p);
+}
+
+/* byte i of the node prefix; bytes past ART_MAX_PREFIX come from a leaf */
+static inline unsigned char prefix_byte(art_node *n, uint32_t depth, uint32_t i, art_leaf **ml)
+{
+    if (i < ART_MAX_PREFIX)
+        return n->prefix[i];
+
+    if (*ml == NULL)
+        *ml = minimum(n);
+    return leaf_key(*ml)[depth + i];
+}
+
+/* number of prefix bytes matching key[depth..], full prefix compared */
+static uint32_t prefix_mismatch(art_node *n, const unsigned char *key, uint32_t ksize, uint32_t depth)
+{
+    uint32_t max = min_u32(n->plen, ksize - depth);
+    art_leaf *ml = NULL;
+    uint32_t i;
+
+    for (i = 0; i < max; i++) {
+        if (prefix_byte(n, depth, i, &ml) != key[depth + i])
+            break;
+    }
+
+    return i;
+}
+
+/* optimistic prefix check: only the stored bytes are compared */
+static inline int prefix_check(const art_node *n, const unsigned char *key, uint32_t ksize, uint32_t depth)
+{
+    if (ksize - depth < n->plen)
+        return -1;
+
+    return memcmp(n->prefix, key + depth, min_u32(n->plen, ART_MAX_PREFIX)) ? -1 : 0;
+}
+
+static void add_child(art_st *t, void **ref, art_node *n, unsigned char c, void *child);
+
+static void add_child256(art_node256 *n, unsigned char c, void *child)
+{
+    n->n.nchild++;
+    n->childs[c] = child;
+}
+
+static void add_child48(art_st *t, void **ref, art_node48 *n, unsigned char c, void *child)
+{
+    if (n->n.nchild < 48) {
+        int pos = 0;
+
+        while (n->childs[pos])
+            pos++;
+        n->childs[pos] = child;
+        n->index[c] = pos + 1;
+        n->n.nchild++;
+    } else {
+        art_node256 *nn = (art_node256 *)node_new(t, ART_NODE256);
+
+        for (int i = 0; i < 256; i++) {
+            if (n->index[i])
+                nn->childs[i] = n->childs[n->index[i] - 1];
+        }
+        node_copy_header(&nn->n, &n->n);
+        *ref = nn;
+        node_free(t, &n->n);
+        add_child256(nn, c, child);
+    }
+}
+
+static void add_child16(art_st *t, void **ref, art_node16 *n, unsigned char c, void *child)
+{
+    if (n->n.nchild < 16) {
+        int idx = 0;
+
+        while (idx < n->n.nchild && n->keys[idx] < c)
+            idx++;
+        memmove(n->keys + idx + 1, n->keys + idx, n->n.nchild - idx);
+        memmove(n->childs + idx + 1, n->childs + idx, (n->n.nchild - idx) * sizeof(void *));
+        n->keys[idx] = c;
+        n->childs[idx] = child;
+        n->n.nchild++;
+    } else {
+        art_node48 *nn = (art_node48 *)node_new(t, ART_NODE48);
+
+        memcpy(nn->childs, n->childs, sizeof(n->childs));
+        for (int i = 0; i < 16; i++)
+            nn->index[n->keys[i]] = i + 1;
+        node_copy_header(&nn->n, &n->n);
+        *ref = nn;
+        node_free(t, &n->n);
+        add_child48(t, ref, nn, c, child);
+    }
+}
+
+static void add_child4(art_st *t, void **ref, art_node4 *n, unsigned char c, void *child)
+{
+    if (n->n.nchild < 4) {
+        int idx = 0;
+
+        while (idx < n->n.nchild && n->keys[idx] < c)
+            idx++;
+        memmove(n->keys + idx + 1, n->keys + idx, n->n.nchild - idx);
+        memmove(n->childs + idx + 1, n->childs + idx, (n->n.nchild - idx) * sizeof(void *));
+        n->keys[idx] = c;
+        n->childs[idx] = child;
+        n->n.nchild++;
+    } else {
+        art_node16 *nn = (art_node16 *)node_new(t, ART_NODE16);
+
+        memcpy(nn->childs, n->childs, sizeof(n->childs));
+        memcpy(nn->keys, n->keys, sizeof(n->keys));
+        node_copy_header(&nn->n, &n->n);
+        *ref = nn;
+        node_free(t, &n->n);
+        add_child16(t, ref, nn, c, child);
+    }
+}
+
+static void add_child(art_st *t, void **ref, art_node *n, unsigned char c, void *child)
+{
+    switch (n->type) {
+    case ART_NODE4:
+        add_child4(t, ref, (art_node4 *)n, c, child);
+        break;
+    case ART_NODE16:
+        add_child16(t, ref, (art_node16 *)n, c, child);
+        break;
+    case ART_NODE48:
+        add_child48(t, ref, (art_node48 *)n, c, child);
+        break;
+    case ART_NODE256:
+        add_child256((art_node256 *)n, c, child);
+        break;
+    }
+}
+
+/*
+ * A Node4 left with a single entry is replaced by it: by its leaf, or by
+ * its only child with the node prefix and the key byte prepended to the
+ * child prefix.
+ */
+static void collapse4(art_st *t, void **ref, art_node4 *n)
+{
+    if (n->n.nchild == 0 && n->n.leaf) {
+        *ref = from_leaf(n->n.leaf);
+    } else if (n->n.nchild == 1 && !n->n.leaf) {
+        void *child = n->childs[0];
+
+        if (!is_leaf(child)) {
+            art_node *c = child;
+            uint32_t plen = n->n.plen;
+
+            if (plen < ART_MAX_PREFIX)
+                n->n.prefix[plen++] = n->keys[0];
+            if (plen < ART_MAX_PREFIX) {
+                uint32_t sub = min_u32(c->plen, ART_MAX_PREFIX - plen);
+
+                memcpy(n->n.prefix + plen, c->prefix, sub);
+                plen += sub;
+            }
+            memcpy(c->prefix, n->n.prefix, min_u32(plen, ART_MAX_PREFIX));
+            c->plen += n->n.plen + 1;
+        }
+        *ref = child;
+    } else {
+        return;
+    }
+
+    node_free(t, &n->n);
+}
+
+static void remove_child(art_st *t, void **ref, art_node *n, unsigned char c, void **slot)
+{
+    switch (n->type) {
+    case ART_NODE4: {
+        art_node4 *p = (art_node4 *)n;
+        int idx = slot - p->childs;
+
+        memmove(p->keys + idx, p->keys + idx + 1, n->nchild - idx - 1);
+        memmove(p->childs + idx, p->childs + idx + 1, (n->nchild - idx - 1) * sizeof(void *));
+        n->nchild--;
+        collapse4(t, ref, p);
+        break;
+    }
+    case ART_NODE16: {
+        art_node16 *p = (art_node16 *)n;
+        int idx = slot - p->childs;
+
+        memmove(p->keys + idx, p->keys + idx + 1, n->nchild - idx - 1);
+        memmove(p->childs + idx, p->childs + idx + 1, (n->nchild - idx - 1) * sizeof(void *));
+        n->nchild--;
+
+        if (n->nchild == 3) {
+            art_node4 *nn = (art_node4 *)node_new(t, ART_NODE4);
+
+            node_copy_header(&nn->n, n);
+            memcpy(nn->keys, p->keys, 3);
+            memcpy(nn->childs, p->childs, 3 * sizeof(void *));
+            *ref = nn;
+            node_free(t, n);
+        }
+        break;
+    }
+    case ART_NODE48: {
+        art_node48 *p = (art_node48 *)n;
+
+        p->childs[p->index[c] - 1] = NULL;
+        p->index[c] = 0;
+        n->nchild--;
+
+        if (n->nchild == 12) {
+            art_node16 *nn = (art_node16 *)node_new(t, ART_NODE16);
+            int j = 0;
+
+            node_copy_header(&nn->n, n);
+            for (int i = 0; i < 256; i++) {
+                if (p->index[i]) {
+                    nn->keys[j] = i;
+                    nn->childs[j++] = p->childs[p->index[i] - 1];
+                }
+            }
+            *ref = nn;
+            node_free(t, n);
+        }
+        break;
+    }
+    case ART_NODE256: {
+        art_node256 *p = (art_node256 *)n;
+
+        p->childs[c] = NULL;
+        n->nchild--;
+
+        if (n->nchild == 37) {
+            art_node48 *nn = (art_node48 *)node_new(t, ART_NODE48);
+            int j = 0;
+
+            node_copy_header(&nn->n, n);
+            for (int i = 0; i < 256; i++) {
+                if (p->childs[i]) {
+                    nn->childs[j] = p->childs[i];
+                    nn->index[i] = ++j;
+                }
+            }
+            *ref = nn;
+            node_free(t, n);
+        }
+        break;
+    }
+    }
+}
+
+static art_leaf *do_lookup(const art_st *t, const unsigned char *key, uint32_t ksize)
+{
+    void *p = t->root;
+    uint32_t depth = 0;
+
+    while (p) {
+        art_node *n;
+        void **slot;
+
+        if (is_leaf(p)) {
+            art_leaf *l = to_leaf(p);
+
+            return leaf_matches(l, key, ksize) ? l : NULL;
+        }
+
+        n = p;
+        if (n->plen) {
+            if (prefix_check(n, key, ksize, depth))
+                return NULL;
+            depth += n->plen;
+        }
+
+        if (depth == ksize)
+            return n->leaf && leaf_matches(n->leaf, key, ksize) ? n->leaf : NULL;
+
+        slot = find_child(n, key[depth]);
+        p = slot ? *slot : NULL;
+        depth++;
+    }
+
+    return NULL;
+}
+
+/* first leaf in key order that is not less than key */
+static art_leaf *do_lower_bound(const art_st *t, const unsigned char *key, uint32_t ksize)
+{
+    void *p = t->root;
+    uint32_t depth = 0;
+
+    while (p) {
+        art_node *n;
+        void **slot;
+        void *next;
+
+        if (is_leaf(p)) {
+            art_leaf *l = to_leaf(p);
+
+            return leaf_cmp(l, key, ksize) >= 0 ? l : l->next;
+        }
+
+        n = p;
+        if (n->plen) {
+            art_leaf *ml = NULL;
+
+            for (uint32_t i = 0; i < n->plen; i++) {
+                unsigned char b;
+
+                if (depth + i == ksize)
+                    return minimum(n);
+
+                b = prefix_byte(n, depth, i, &ml);
+                if (b < key[depth + i])
+                    return maximum(n)->next;
+                if (b > key[depth + i])
+                    return minimum(n);
+            }
+            depth += n->plen;
+        }
+
+        if (depth == ksize)
+            return minimum(n);
+
+        slot = find_child(n, key[depth]);
+        if (slot) {
+            p = *slot;
+            depth++;
+            continue;
+        }
+
+        next = next_child(n, key[depth]);
+        return next ? minimum(next) : maximum(n)->next;
+    }
+
+    return NULL;
+}
+
+/* allocate a leaf and link it into the leaf list in front of succ */
+static art_leaf *leaf_new(art_st *t, const void *key, uint32_t ksize, void *val, art_leaf *succ)
+{
+    art_leaf *l;
+
+    if (t->flag & AFLAG_EXTERN_KEY) {
+        l = xmalloc0(sizeof(art_leaf));
+        l->cs.key = (void *)key;
+    } else {
+        l = xmalloc0(sizeof(art_leaf) + ksize);
+        memcpy(l->kbuf, key, ksize);
+        l->cs.key = l->kbuf;
+    }
+    l->cs.ksize = ksize;
+    l->cs.data = val;
+
+    l->next = succ;
+    l->prev = succ ? succ->prev : t->last;
+    if (l->prev)
+        l->prev->next = l;
+    else
+        t->first = l;
+    if (succ)
+        succ->prev = l;
+    else
+        t->last = l;
+
+    t->nelem++;
+    return l;
+}
+
+/*
+ * Single descent for an insert: return the leaf already holding key with
+ * *found set, or attach a new leaf where the descent stops.  Prefixes are
+ * compared in full on the way down, so every key outside the subtree at
+ * the attach point orders against the new key as it does against that
+ * subtree, and the new leaf's successor is found from the subtree alone.
+ */
+static art_leaf *insert_rec(art_st *t, void **ref, const unsigned char *key, uint32_t ksize,
+                            void *val, int *found)
+{
+    uint32_t depth = 0;
+    art_leaf *leaf;
+
+    *found = 0;
+    for (;;) {
+        void *p = *ref;
+        art_node *n;
+        void **slot;
+        void *next;
+
+        if (p == NULL) {
+            leaf = leaf_new(t, key, ksize, val, NULL);
+            *ref = from_leaf(leaf);
+            return leaf;
+        }
+
+        if (is_leaf(p)) {
+            art_leaf *l = to_leaf(p);
+            const unsigned char *lkey = leaf_key(l);
+            uint32_t max = min_u32(l->cs.ksize, ksize);
+            uint32_t lcp = depth;
+            art_node *nn;
+
+            if (leaf_matches(l, key, ksize)) {
+                *found = 1;
+                return l;
+            }
+
+            while (lcp < max && lkey[lcp] == key[lcp])
+                lcp++;
+
+            /* l is the only key sharing key[0, depth), so it is a neighbour */
+            if (lcp == l->cs.ksize || (lcp < ksize && lkey[lcp] < key[lcp]))
+                leaf = leaf_new(t, key, ksize, val, l->next);
+            else
+                leaf = leaf_new(t, key, ksize, val, l);
+
+            nn = node_new(t, ART_NODE4);
+            nn->plen = lcp - depth;
+            memcpy(nn->prefix, key + depth, min_u32(nn->plen, ART_MAX_PREFIX));
+            *ref = nn;
+
+            if (l->cs.ksize == lcp)
+                nn->leaf = l;
+            else
+                add_child(t, ref, nn, lkey[lcp], p);
+
+            if (ksize == lcp)
+                nn->leaf = leaf;
+            else
+                add_child(t, ref, nn, key[lcp], from_leaf(leaf));
+            return leaf;
+        }
+
+        n = p;
+        if (n->plen) {
+            uint32_t diff = prefix_mismatch(n, key, ksize, depth);
+
+            if (diff < n->plen) {
+                art_node *nn;
+                art_leaf *ml = NULL;
+                unsigned char c = prefix_byte(n, depth, diff, &ml);
+
+                /* the new key sorts before or after the whole subtree */
+                if (depth + diff == ksize || key[depth + diff] < c)
+                    leaf = leaf_new(t, key, ksize, val, minimum(n));
+                else
+                    leaf = leaf_new(t, key, ksize, val, maximum(n)->next);
+
+                nn = node_new(t, ART_NODE4);
+                nn->plen = diff;
+                memcpy(nn->prefix, n->prefix, min_u32(diff, ART_MAX_PREFIX));
+                *ref = nn;
+
+                if (n->plen <= ART_MAX_PREFIX) {
+                    n->plen -= diff + 1;
+                    memmove(n->prefix, n->prefix + diff + 1, min_u32(n->plen, ART_MAX_PREFIX));
+                } else {
+                    const unsigned char *mkey = leaf_key(minimum(n));
+
+                    n->plen -= diff + 1;
+                    memcpy(n->prefix, mkey + depth + diff + 1, min_u32(n->plen, ART_MAX_PREFIX));
+                }
+                add_child(t, ref, nn, c, n);
+
+                if (depth + diff == ksize)
+                    nn->leaf = leaf;
+                else
+                    add_child(t, ref, nn, key[depth + diff], from_leaf(leaf));
+                return leaf;
+            }
+            depth += n->plen;
+        }
+
+        if (depth == ksize) {
+            if (n->leaf) {
+                *found = 1;
+                return n->leaf;
+            }
+            leaf = leaf_new(t, key, ksize, val, minimum(n));
+            n->leaf = leaf;
+            return leaf;
+        }
+
+        slot = find_child(n, key[depth]);
+        if (slot == NULL) {
+            next = next_child(n, key[depth]);
+            leaf = leaf_new(t, key, ksize, val, next ? minimum(next) : maximum(n)->next);
+            add_child(t, ref, n, key[depth], from_leaf(leaf));
+            return leaf;
+        }
+
+        ref = slot;
+        depth++;
+    }
+}
+
+static art_leaf *delete_rec(art_st *t, void **ref, const unsigned char *key, uint32_t ksize)
+{
+    uint32_t depth = 0;
+
+    for (;;) {
+        void *p = *ref;
+        art_node *n;
+        art_leaf *l;
+        void **slot;
+
+        if (p == NULL)
+            return NULL;
+
+        if (is_leaf(p)) {
+            /* only reached for a leaf at the root */
+            l = to_leaf(p);
+            if (!leaf_matches(l, key, ksize))
+                return NULL;
+            *ref = NULL;
+            return l;
+        }
+
+        n = p;
+        if (n->plen) {
+            if (prefix_check(n, key, ksize, depth))
+                return NULL;
+            depth += n->plen;
+        }
+
+        if (depth == ksize) {
+            l = n->leaf;
+            if (l == NULL || !leaf_matches(l, key, ksize))
+                return NULL;
+            n->leaf = NULL;
+            if (n->type == ART_NODE4)
+                collapse4(t, ref, (art_node4 *)n);
+            return l;
+        }
+
+        slot = find_child(n, key[depth]);
+        if (slot == NULL)
+            return NULL;
+
+        if (is_leaf(*slot)) {
+            l = to_leaf(*slot);
+            if (!leaf_matches(l, key, ksize))
+                return NULL;
+            remove_child(t, ref, n, key[depth], slot);
+            return l;
+        }
+
+        ref = slot;
+        depth++;
+    }
+}
+
+static void node_destroy(art_st *t, void *p)
+{
+    art_node *n = p;
+    void **childs = NULL;
+    int cnt = 0;
+
+    if (is_leaf(p))
+        return;
+
+    switch (n->type) {
+    case ART_NODE4:
+        childs = ((art_node4 *)n)->childs;
+        cnt = n->nchild;
+        break;
+    case ART_NODE16:
+        childs = ((art_node16 *)n)->childs;
+        cnt = n->nchild;
+        break;
+    case ART_NODE48:
+        childs = ((art_node48 *)n)->childs;
+        cnt = 48;
+        break;
+    case ART_NODE256:
+        childs = ((art_node256 *)n)->childs;
+        cnt = 256;
+        break;
+    }
+
+    for (int i = 0; i < cnt; i++) {
+        if (childs[i])
+            node_destroy(t, childs[i]);
+    }
+
+    node_free(t, n);
+}
+
+art_st *art_create(art_data_free_func_t data_free, int flag)
+{
+    art_st *t = xmalloc0(sizeof(art_st));
+
+    t->flag = flag;
+    t->data_free = data_free;
+    return t;
+}
+
+void art_destroy(art_st *t)
+{
+    art_leaf *l, *next;
+
+    if (!t)
+        return;
+
+    if (t->root)
+        node_destroy(t, t->root);
+
+    for (l = t->first; l; l = next) {
+        next = l->next;
+        if ((void *)t->data_free)
+            t->data_free(l->cs.data);
+        free(l);
+    }
+
+    free(t);
+}
+
+uint32_t art_count(art_st *t)
+{
+    return t->nelem;
+}
+
+const art_cursor_st *art_first(const art_st *t)
+{
+    return t->first ? &t->first->cs : NULL;
+}
+
+const art_cursor_st *art_last(const art_st *t)
+{
+    return t->last ? &t->last->cs : NULL;
+}
+
+const art_cursor_st *art_next(const art_cursor_st *itor)
+{
+    const art_leaf *l = (const art_leaf *)itor;
+
+    return l->next ? &l->next->cs : NULL;
+}
+
+const art_cursor_st *art_prev(const art_cursor_st *itor)
+{
+    const art_leaf *l = (const art_leaf *)itor;
+
+    return l->prev ? &l->prev->cs : NULL;
+}
+
+int art_search(const art_st *t, const void *key, uint32_t ksize, void **val)
+{
+    art_leaf *l = do_lookup(t, key, ksize);
+
+    if (!l)
+        return -1;
+
+    if (val)
+        *val = l->cs.data;
+    return 0;
+}
+
+const art_cursor_st *art_get_cursor(const art_st *t, const void *key, uint32_t ksize)
+{
+    art_leaf *l = do_lookup(t, key, ksize);
+
+    return l ? &l->cs : NULL;
+}
+
+const art_cursor_st *art_lower_bound(const art_st *t, const void *key, uint32_t ksize)
+{
+    art_leaf *l = do_lower_bound(t, key, ksize);
+
+    return l ? &l->cs : NULL;
+}
+
+const art_cursor_st *art_upper_bound(const art_st *t, const void *key, uint32_t ksize)
+{
+    art_leaf *l = do_lower_bound(t, key, ksize);
+
+    if (l == NULL)
+        l = t->last;
+    else if (!leaf_matches(l, key, ksize))
+        l = l->prev;
+
+    return l ? &l->cs : NULL;
+}
+
+void art_insert(art_st *t, const void *key, uint32_t ksize, void *val)
+{
+    int found;
+    art_leaf *l = insert_rec(t, &t->root, key, ksize, val, &found);
+
+    if (found) {
+        if ((void *)t->data_free)
+            t->data_free(l->cs.data);
+
+        if (t->flag & AFLAG_EXTERN_KEY)
+            l->cs.key = (void *)key;
+        l->cs.data = val;
+    }
+}
+
+void art_delete(art_st *t, const void *key, uint32_t ksize)
+{
+    art_leaf *l = delete_rec(t, &t->root, key, ksize);
+
+    if (!l)
+        return;
+
+    if (l->prev)
+        l->prev->next = l->next;
+    else
+        t->first = l->next;
+    if (l->next)
+        l->next->prev = l->prev;
+    else
+        t->last = l->prev;
+
+    if ((void *)t->data_free)
+        t->data_free(l->cs.data);
+
+    free(l);
+    t->nelem--;
+}
+
+int art_foreach(art_st *t, void *data, art_foreach_func_t fn)
+{
+    const art_cursor_st *cs;
+    int res;
+
+    if (!(void *)fn)
+        return 0;
+
+    for (cs = art_first(t); cs; cs = art_next(cs)) {
+        if ((res = fn(cs->key, cs->ksize, cs->data, data)))
+            return res;
+    }
+
+    return 0;
+}
+
+uint32_t art_size(art_st *t)
+{
+    uint32_t size = t->nbytes + t->nelem * sizeof(art_leaf);
+
+    if (!(t->flag & AFLAG_EXTERN_KEY)) {
+        for (art_leaf *l = t->first; l; l = l->next)
+            size += l->cs.ksize;
+    }
+
+    return size;
+}
+
+#ifdef TEST_ART
+
+#include <stdio.h>
+#include <time.h>
+
+#include "rbtree.h"
+#include "hash.h"
+
+#define UNIVERSE 40000
+#define NKEYS (1 << 20)
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const void *cs_data(const void *cs, int art)
+{
+    if (!cs)
+        return NULL;
+    return art ? ((const art_cursor_st *)cs)->data : ((const rb_cursor_st *)cs)->data;
+}
+
+static void count_nodes(void *p, uint32_t *counts)
+{
+    art_node *n = p;
+
+    if (!p || is_leaf(p))
+        return;
+
+    counts[n->type]++;
+    for (int c = 0; c < 256; c++) {
+        void **slot = find_child(n, (unsigned char)c);
+
+        if (slot)
+            count_nodes(*slot, counts);
+    }
+}
+
+/*
+ * Keys built around a 24-byte stem, longer than ART_MAX_PREFIX:
+ *   - truncations of the stem, each a prefix of every longer key;
+ *   - the stem plus one byte of any value, which fills a Node256;
+ *   - the stem plus one to three bytes from a 40-letter alphabet, which
+ *     gives Node48s near the stem and smaller nodes further down;
+ *   - the stem with one byte changed past ART_MAX_PREFIX, which splits
+ *     a prefix that is only partly stored in the node.
+ */
+static uint32_t make_key(unsigned char *key, unsigned *seed)
+{
+    static const char stem[] = "tenant/0123456789abcdef/";
+    uint32_t n = sizeof(stem) - 1;
+    int kind = rand_r(seed) % 8;
+
+    memcpy(key, stem, n);
+    switch (kind) {
+    case 0:
+        return 1 + rand_r(seed) % n;
+    case 1:
+    case 2:
+        key[n++] = (unsigned char)(rand_r(seed) % 256);
+        return n;
+    case 3:
+    case 4:
+        key[ART_MAX_PREFIX + 1 + rand_r(seed) % (n - ART_MAX_PREFIX - 1)] = 'A' + rand_r(seed) % 3;
+        /* fall through */
+    default:
+        for (int i = 1 + rand_r(seed) % 3; i > 0; i--)
+            key[n++] = (unsigned char)('a' + rand_r(seed) % 40);
+        return n;
+    }
+}
+
+/*
+ * Random inserts and deletes checked against an rbtree, whose default
+ * comparator has the same order: bytewise, a prefix before its extensions.
+ * The tree grows to a peak and then drains completely.
+ */
+static int model_check(int flag)
+{
+    static unsigned char keys[UNIVERSE][32];
+    static uint32_t ksizes[UNIVERSE];
+    art_st *t = art_create(NULL, flag);
+    rbtree_st *ref = rbtree_create(NULL, NULL, 0);
+    uint32_t counts[ART_NODE256 + 1] = {0};
+    unsigned seed = 7;
+
+    for (int i = 0; i < UNIVERSE; i++)
+        ksizes[i] = make_key(keys[i], &seed);
+
+    for (int op = 0; op < 300000; op++) {
+        int i = rand_r(&seed) % UNIVERSE;
+
+        if (op == 150000)
+            count_nodes(t->root, counts);
+
+        if (rand_r(&seed) % 100 < (op < 150000 ? 70 : 30)) {
+            art_insert(t, keys[i], ksizes[i], (void *)(uintptr_t)(i + 1));
+            rbtree_insert(ref, keys[i], ksizes[i], (void *)(uintptr_t)(i + 1));
+        } else {
+            art_delete(t, keys[i], ksizes[i]);
+            rbtree_delete(ref, keys[i], ksizes[i]);
+        }
+
+        if (art_count(t) != rbtree_count(ref))
+            return printf("FAIL count after op %d\n", op), 1;
+
+        /* query with a key, or a truncation of one */
+        i = rand_r(&seed) % UNIVERSE;
+        uint32_t n = rand_r(&seed) % 2 ? ksizes[i] : rand_r(&seed) % (ksizes[i] + 1);
+        if (cs_data(art_lower_bound(t, keys[i], n), 1) != cs_data(rbtree_lower_bound(ref, keys[i], n), 0) ||
+            cs_data(art_upper_bound(t, keys[i], n), 1) != cs_data(rbtree_upper_bound(ref, keys[i], n), 0) ||
+            cs_data(art_get_cursor(t, keys[i], n), 1) != cs_data(rbtree_get_cursor(ref, keys[i], n), 0))
+            return printf("FAIL bounds of key %d/%u after op %d\n", i, n, op), 1;
+
+        const art_cursor_st *ac = art_lower_bound(t, keys[i], n);
+        const rb_cursor_st *rc = rbtree_lower_bound(ref, keys[i], n);
+        for (int s = 0; s < 40 && ac; s++) {
+            if (cs_data(ac, 1) != cs_data(rc, 0))
+                return printf("FAIL walk from key %d/%u after op %d\n", i, n, op), 1;
+            if (s < 20) {
+                ac = art_next(ac);
+                rc = rbtree_next(rc);
+            } else {
+                ac = art_prev(ac);
+                rc = rbtree_prev(rc);
+            }
+        }
+        if (cs_data(ac, 1) != cs_data(rc, 0))
+            return printf("FAIL walk end from key %d/%u after op %d\n", i, n, op), 1;
+    }
+
+    if (!counts[ART_NODE4] || !counts[ART_NODE16] || !counts[ART_NODE48] || !counts[ART_NODE256])
+        return printf("FAIL node mix at peak: %u/%u/%u/%u\n", counts[ART_NODE4], counts[ART_NODE16],
+                      counts[ART_NODE48], counts[ART_NODE256]), 1;
+
+    for (int i = 0; i < UNIVERSE; i++)
+        art_delete(t, keys[i], ksizes[i]);
+    if (art_count(t) || art_first(t) || art_last(t) || t->root || art_size(t))
+        return printf("FAIL drain leaves %u keys, %u bytes\n", art_count(t), art_size(t)), 1;
+
+    art_destroy(t);
+    rbtree_destroy(ref);
+    return 0;
+}
+
+/*
+ * Session-ID workload: 1M random 32-character hex IDs, looked up in
+ * random order, against a pooled rbtree and the string hash table.
+ */
+int main(void)
+{
+    static char ids[NKEYS][33], miss[NKEYS][33];
+    unsigned long long x = 88172645463325252ULL;
+    size_t hits[3] = {0, 0, 0}, sum[2] = {0, 0};
+    double t[3][3], t0;
+
+    if (model_check(0) || model_check(AFLAG_EXTERN_KEY))
+        return 1;
+
+    for (int i = 0; i < 2 * NKEYS; i++) {
+        char *id = i < NKEYS ? ids[i] : miss[i - NKEYS];
+
+        for (int j = 0; j < 32; j += 16) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            snprintf(id + j, 17, "%016llx", x);
+        }
+    }
+
+    art_st *art = art_create(NULL, AFLAG_EXTERN_KEY);
+    rbtree_st *rb = rbtree_create(NULL, NULL, RFLAG_EXTERN_KEY | RFLAG_NODE_POOL);
+    hash_table_t *ht = make_string_hash_table(0);
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        art_insert(art, ids[i], 32, ids[i]);
+    t[0][0] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        rbtree_insert(rb, ids[i], 32, ids[i]);
+    t[1][0] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hash_table_put(ht, ids[i], ids[i]);
+    t[2][0] = now() - t0;
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[0] += art_search(art, ids[(i * 7919L) % NKEYS], 32, NULL) == 0;
+    t[0][1] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[1] += rbtree_search(rb, ids[(i * 7919L) % NKEYS], 32, NULL) == 0;
+    t[1][1] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[2] += hash_table_get(ht, ids[(i * 7919L) % NKEYS]) != NULL;
+    t[2][1] = now() - t0;
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[0] += art_search(art, miss[i], 32, NULL) == 0;
+    t[0][2] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[1] += rbtree_search(rb, miss[i], 32, NULL) == 0;
+    t[1][2] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits[2] += hash_table_get(ht, miss[i]) != NULL;
+    t[2][2] = now() - t0;
+
+    printf("%-8s %10s %10s %10s   (ns per key)\n", "", "insert", "hit", "miss");
+    printf("%-8s %10.0f %10.0f %10.0f\n", "art", t[0][0] * 1e9 / NKEYS, t[0][1] * 1e9 / NKEYS, t[0][2] * 1e9 / NKEYS);
+    printf("%-8s %10.0f %10.0f %10.0f\n", "rbtree", t[1][0] * 1e9 / NKEYS, t[1][1] * 1e9 / NKEYS, t[1][2] * 1e9 / NKEYS);
+    printf("%-8s %10.0f %10.0f %10.0f\n", "hash", t[2][0] * 1e9 / NKEYS, t[2][1] * 1e9 / NKEYS, t[2][2] * 1e9 / NKEYS);
+    if (hits[0] != NKEYS || hits[1] != NKEYS || hits[2] != NKEYS)
+        printf("hit counts MISMATCH: %zu %zu %zu\n", hits[0], hits[1], hits[2]);
+
+    /* ordered scans, which the hash table cannot answer */
+    t0 = now();
+    for (int i = 0; i < 20000; i++) {
+        const art_cursor_st *cs = art_lower_bound(art, miss[i], 32);
+        for (int j = 0; j < 100 && cs; j++, cs = art_next(cs))
+            sum[0] += cs->ksize;
+    }
+    t[0][0] = now() - t0;
+    t0 = now();
+    for (int i = 0; i < 20000; i++) {
+        const rb_cursor_st *cs = rbtree_lower_bound(rb, miss[i], 32);
+        for (int j = 0; j < 100 && cs; j++, cs = rbtree_next(cs))
+            sum[1] += cs->ksize;
+    }
+    t[1][0] = now() - t0;
+    printf("lower_bound + 100 next: art %.0f ns, rbtree %.0f ns (%s)\n", t[0][0] * 1e9 / 20000,
+           t[1][0] * 1e9 / 20000, sum[0] == sum[1] ? "ok" : "MISMATCH");
+    printf("memory: art %u bytes, rbtree %u bytes, hash %zu bytes\n", art_size(art), rbtree_size(rb),
+           hash_table_memory(ht));
+
+    art_destroy(art);
+    rbtree_destroy(rb);
+    hash_table_destroy(ht);
+    return 0;
+}
+#endif /* TEST_ART */
@@ -0,0 +1,173 @@
+/**
+ * @file art.h
+ * @brief Adaptive radix tree: an ordered index for byte-string keys
+ *
+ * Keys are ordered like the default rbtree comparator: bytewise, with a
+ * key sorting before every longer key it is a prefix of.  Inner nodes
+ * adapt between 4, 16, 48 and 256 children and compress single-child
+ * paths into a prefix.  Leaves are kept on a doubly linked list in key
+ * order, so cursor stepping is O(1).
+ */
+
+#ifndef __ART_H__
+#define __ART_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Structure representing an adaptive radix tree
+ */
+struct art_st;
+typedef struct art_st art_st;
+
+/**
+ * @brief Function pointer type for freeing data associated with a key
+ * @param data Pointer to the data to be freed
+ */
+typedef void (*art_data_free_func_t)(void *data);
+
+/**
+ * @brief Flag indicating that the tree should reference keys instead of copying them
+ */
+#define AFLAG_EXTERN_KEY 0x1
+
+/**
+ * @brief Structure representing a cursor for iterating over a tree,
+ *        laid out like rb_cursor_st
+ */
+typedef struct art_cursor_st {
+    void *key;      /**< Pointer to the key */
+    uint32_t ksize; /**< Size of the key */
+    void *data;     /**< Pointer to the data */
+} art_cursor_st;
+
+/**
+ * @brief Create a new adaptive radix tree
+ * @param data_free Function pointer for freeing data associated with a key
+ * @param flag Flag indicating whether to use external memory for keys
+ * @return Pointer to the newly created tree
+ */
+art_st *art_create(art_data_free_func_t data_free, int flag);
+
+/**
+ * @brief Destroy a tree and free all associated memory
+ * @param t Pointer to the tree to be destroyed
+ */
+void art_destroy(art_st *t);
+
+/**
+ * @brief Get the number of keys in a tree
+ * @param t Pointer to the tree
+ * @return The number of keys in the tree
+ */
+uint32_t art_count(art_st *t);
+
+/**
+ * @brief Get the cursor for the smallest key
+ * @param t Pointer to the tree
+ * @return Pointer to the cursor, or NULL if the tree is empty
+ */
+const art_cursor_st *art_first(const art_st *t);
+
+/**
+ * @brief Get the cursor for the largest key
+ * @param t Pointer to the tree
+ * @return Pointer to the cursor, or NULL if the tree is empty
+ */
+const art_cursor_st *art_last(const art_st *t);
+
+/**
+ * @brief Get the cursor for the next key
+ * @param itor Pointer to the cursor for the current key
+ * @return Pointer to the cursor for the next key, or NULL if there is no next key
+ */
+const art_cursor_st *art_next(const art_cursor_st *itor);
+
+/**
+ * @brief Get the cursor for the previous key
+ * @param itor Pointer to the cursor for the current key
+ * @return Pointer to the cursor for the previous key, or NULL if there is no previous key
+ */
+const art_cursor_st *art_prev(const art_cursor_st *itor);
+
+/**
+ * @brief Search for a key and return its value
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @param val Pointer to a variable to store the value, or NULL if the value is not needed
+ * @return 0 if the key is found, -1 otherwise
+ */
+int art_search(const art_st *t, const void *key, uint32_t ksize, void **val);
+
+/**
+ * @brief Search for a key and return its cursor
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if the key is not found
+ */
+const art_cursor_st *art_get_cursor(const art_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Search for the first key greater than or equal to a given key
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if there is no such key
+ */
+const art_cursor_st *art_lower_bound(const art_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Search for the last key less than or equal to a given key
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if there is no such key
+ */
+const art_cursor_st *art_upper_bound(const art_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Insert a key and value, replacing the value if the key exists
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to insert
+ * @param ksize Size of the key
+ * @param val Pointer to the value to insert
+ */
+void art_insert(art_st *t, const void *key, uint32_t ksize, void *val);
+
+/**
+ * @brief Delete a key from the tree
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to delete
+ * @param ksize Size of the key
+ */
+void art_delete(art_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Function pointer type for iterating over a tree
+ * @param key Pointer to the key
+ * @param ksize Size of the key
+ * @param val Pointer to the value
+ * @param userdata Pointer to user-defined data
+ * @return A non-zero value to stop iterating and return that value from art_foreach()
+ */
+typedef int (*art_foreach_func_t)(const void *key, int ksize, void *val, void *userdata);
+
+/**
+ * @brief Iterate over the tree in key order
+ * @param t Pointer to the tree
+ * @param userdata Pointer to user-defined data to pass to the function
+ * @param fn Function to call for each key
+ * @return 0 if the iteration completes, or the non-zero value returned by fn
+ */
+int art_foreach(art_st *t, void *userdata, art_foreach_func_t fn);
+
+/**
+ * @brief Get the memory used by the tree's nodes and leaves
+ * @param t Pointer to the tree
+ * @return The size of the tree in bytes
+ */
+uint32_t art_size(art_st *t);
+
+#endif
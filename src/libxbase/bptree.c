@@ -0,0 +1,917 @@
+/*
+ * bptree - B+tree ordered map.
+ *
+ * Inner nodes hold separator keys and child pointers, leaves hold the
+ * entries and are linked in key order.  Every node is BPT_NODE_SIZE bytes
+ * and leaves are allocated on a BPT_NODE_SIZE boundary, so the leaf that
+ * owns a cursor is found by masking the cursor's address.
+ *
+ * Separators are always private copies: with external keys the caller may
+ * free a key once it is deleted, but a copy of it can still separate two
+ * subtrees.  A separator only has to satisfy
+ *
+ *     every key in child[i] < key[i] <= every key in child[i + 1]
+ *
+ * so deleting the entry it was copied from does not require updating it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "xmalloc.h"
+#include "bptree.h"
+
+typedef struct bpt_node_st {
+    uint32_t n;    /* entries in a leaf, separator keys in an inner node */
+    uint32_t leaf;
+} bpt_node_st;
+
+#define BPT_LEAF_MAX                                                       \
+    ((BPT_NODE_SIZE - sizeof(bpt_node_st) - 2 * sizeof(void *)) /         \
+     (sizeof(uint64_t) + sizeof(bptree_cursor_st)))
+#define BPT_INNER_MAX                                                      \
+    ((BPT_NODE_SIZE - sizeof(bpt_node_st) - sizeof(void *)) /             \
+     (sizeof(uint64_t) + 2 * sizeof(void *) + sizeof(uint32_t)))
+#define BPT_LEAF_MIN (BPT_LEAF_MAX / 2)
+#define BPT_INNER_MIN (BPT_INNER_MAX / 2)
+#define BPT_MAX_DEPTH 32
+
+/*
+ * pfx[] caches the first 8 key bytes, zero padded and read big-endian, so
+ * for the default comparator pfx(a) < pfx(b) implies a < b and only equal
+ * prefixes need the full comparison.  It is 0 with a custom comparator.
+ */
+typedef struct bpt_leaf_st {
+    bpt_node_st h;
+    struct bpt_leaf_st *prev, *next;
+    uint64_t pfx[BPT_LEAF_MAX];
+    bptree_cursor_st ent[BPT_LEAF_MAX];
+} bpt_leaf_st;
+
+typedef struct bpt_inner_st {
+    bpt_node_st h;
+    uint64_t pfx[BPT_INNER_MAX];
+    void *key[BPT_INNER_MAX];
+    uint32_t ksize[BPT_INNER_MAX];
+    bpt_node_st *child[BPT_INNER_MAX + 1];
+} bpt_inner_st;
+
+_Static_assert(sizeof(bpt_leaf_st) <= BPT_NODE_SIZE, "leaf too large");
+_Static_assert(sizeof(bpt_inner_st) <= BPT_NODE_SIZE, "inner node too large");
+
+struct bptree_st {
+    bpt_node_st *root;
+    bpt_leaf_st *first, *last;
+    uint32_t nelem;
+    uint32_t nnode;
+    int height; /* 0 when empty, 1 when the root is a leaf */
+    int flag;
+    int use_pfx;
+    bptree_cmp_func_t cmp_fn;
+    bptree_data_free_func_t data_free;
+};
+
+#define leaf_of(cs) ((bpt_leaf_st *)((uintptr_t)(cs) & ~(uintptr_t)(BPT_NODE_SIZE - 1)))
+
+static void *node_new(bptree_st *t, int leaf)
+{
+    bpt_node_st *node = aligned_alloc(BPT_NODE_SIZE, BPT_NODE_SIZE);
+
+    if (!node) {
+        fprintf(stderr, "aligned_alloc: failed to allocate %d bytes,memory exhausted.", BPT_NODE_SIZE);
+        exit(1);
+    }
+
+    node->n = 0;
+    node->leaf = leaf;
+    t->nnode++;
+    return node;
+}
+
+static void node_free(bptree_st *t, void *node)
+{
+    free(node);
+    t->nnode--;
+}
+
+static void *key_dup(const void *key, uint32_t ksize)
+{
+    void *copy = xmalloc(ksize);
+
+    memcpy(copy, key, ksize);
+    return copy;
+}
+
+static inline uint64_t key_prefix(const bptree_st *t, const void *key, uint32_t ksize)
+{
+    uint8_t b[8] = {0};
+
+    if (!t->use_pfx)
+        return 0;
+
+    memcpy(b, key, ksize < 8 ? ksize : 8);
+    return ((uint64_t)b[0] << 56) | ((uint64_t)b[1] << 48) | ((uint64_t)b[2] << 40) |
+           ((uint64_t)b[3] << 32) | ((uint64_t)b[4] << 24) | ((uint64_t)b[5] << 16) |
+           ((uint64_t)b[6] << 8) | (uint64_t)b[7];
+}
+
+static inline int key_cmp(const bptree_st *t, uint64_t p1, const void *k1, uint32_t n1,
+                          uint64_t p2, const void *k2, uint32_t n2)
+{
+    if (p1 != p2)
+        return p1 < p2 ? -1 : 1;
+
+    return t->cmp_fn(k1, n1, k2, n2);
+}
+
+/* index of the first entry >= key, *eq set if it is equal */
+static uint32_t leaf_find(const bptree_st *t, const bpt_leaf_st *lf, uint64_t pfx,
+                          const void *key, uint32_t ksize, int *eq)
+{
+    uint32_t lo = 0, hi = lf->h.n;
+
+    *eq = 0;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int res = key_cmp(t, lf->pfx[mid], lf->ent[mid].key, lf->ent[mid].ksize, pfx, key, ksize);
+
+        if (res < 0) {
+            lo = mid + 1;
+        } else {
+            *eq |= res == 0;
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* index of the child whose range contains key: the number of separators <= key */
+static uint32_t inner_find(const bptree_st *t, const bpt_inner_st *in, uint64_t pfx,
+                           const void *key, uint32_t ksize)
+{
+    uint32_t lo = 0, hi = in->h.n;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (key_cmp(t, in->pfx[mid], in->key[mid], in->ksize[mid], pfx, key, ksize) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ * Walk down to the leaf whose range contains key.  When 'path' is given the
+ * inner nodes and the child index taken in each are recorded for inserts
+ * and deletes.
+ */
+static bpt_leaf_st *descend(const bptree_st *t, uint64_t pfx, const void *key, uint32_t ksize,
+                            bpt_inner_st **path, uint32_t *idx, int *depth)
+{
+    bpt_node_st *node = t->root;
+    int d = 0;
+
+    while (!node->leaf) {
+        bpt_inner_st *in = (bpt_inner_st *)node;
+        uint32_t i = inner_find(t, in, pfx, key, ksize);
+
+        if (path) {
+            path[d] = in;
+            idx[d] = i;
+        }
+        d++;
+        node = in->child[i];
+    }
+
+    if (depth)
+        *depth = d;
+    return (bpt_leaf_st *)node;
+}
+
+const bptree_cursor_st *bptree_first(const bptree_st *t)
+{
+    return t->first ? &t->first->ent[0] : NULL;
+}
+
+const bptree_cursor_st *bptree_last(const bptree_st *t)
+{
+    return t->last ? &t->last->ent[t->last->h.n - 1] : NULL;
+}
+
+const bptree_cursor_st *bptree_next(const bptree_cursor_st *itor)
+{
+    bpt_leaf_st *lf = leaf_of(itor);
+
+    if (itor + 1 < &lf->ent[lf->h.n])
+        return itor + 1;
+
+    return lf->next ? &lf->next->ent[0] : NULL;
+}
+
+const bptree_cursor_st *bptree_prev(const bptree_cursor_st *itor)
+{
+    bpt_leaf_st *lf = leaf_of(itor);
+
+    if (itor > &lf->ent[0])
+        return itor - 1;
+
+    return lf->prev ? &lf->prev->ent[lf->prev->h.n - 1] : NULL;
+}
+
+const bptree_cursor_st *bptree_get_cursor(const bptree_st *t, const void *key, uint32_t ksize)
+{
+    uint64_t pfx;
+    bpt_leaf_st *lf;
+    uint32_t i;
+    int eq;
+
+    if (!t->root)
+        return NULL;
+
+    pfx = key_prefix(t, key, ksize);
+    lf = descend(t, pfx, key, ksize, NULL, NULL, NULL);
+    i = leaf_find(t, lf, pfx, key, ksize, &eq);
+
+    return eq ? &lf->ent[i] : NULL;
+}
+
+int bptree_search(const bptree_st *t, const void *key, uint32_t ksize, void **val)
+{
+    const bptree_cursor_st *cs = bptree_get_cursor(t, key, ksize);
+
+    if (!cs)
+        return -1;
+    if (val)
+        *val = cs->data;
+    return 0;
+}
+
+const bptree_cursor_st *bptree_lower_bound(const bptree_st *t, const void *key, uint32_t ksize)
+{
+    uint64_t pfx;
+    bpt_leaf_st *lf;
+    uint32_t i;
+    int eq;
+
+    if (!t->root)
+        return NULL;
+
+    pfx = key_prefix(t, key, ksize);
+    lf = descend(t, pfx, key, ksize, NULL, NULL, NULL);
+    i = leaf_find(t, lf, pfx, key, ksize, &eq);
+
+    /* everything in the following leaves is >= the separator above it > key */
+    if (i < lf->h.n)
+        return &lf->ent[i];
+    return lf->next ? &lf->next->ent[0] : NULL;
+}
+
+const bptree_cursor_st *bptree_upper_bound(const bptree_st *t, const void *key, uint32_t ksize)
+{
+    uint64_t pfx;
+    bpt_leaf_st *lf;
+    uint32_t i;
+    int eq;
+
+    if (!t->root)
+        return NULL;
+
+    pfx = key_prefix(t, key, ksize);
+    lf = descend(t, pfx, key, ksize, NULL, NULL, NULL);
+    i = leaf_find(t, lf, pfx, key, ksize, &eq);
+
+    if (eq)
+        return &lf->ent[i];
+    if (i > 0)
+        return &lf->ent[i - 1];
+    return lf->prev ? &lf->prev->ent[lf->prev->h.n - 1] : NULL;
+}
+
+static void leaf_insert_at(bpt_leaf_st *lf, uint32_t i, uint64_t pfx, const bptree_cursor_st *ent)
+{
+    memmove(&lf->pfx[i + 1], &lf->pfx[i], (lf->h.n - i) * sizeof(lf->pfx[0]));
+    memmove(&lf->ent[i + 1], &lf->ent[i], (lf->h.n - i) * sizeof(lf->ent[0]));
+    lf->pfx[i] = pfx;
+    lf->ent[i] = *ent;
+    lf->h.n++;
+}
+
+static void leaf_remove_at(bpt_leaf_st *lf, uint32_t i)
+{
+    lf->h.n--;
+    memmove(&lf->pfx[i], &lf->pfx[i + 1], (lf->h.n - i) * sizeof(lf->pfx[0]));
+    memmove(&lf->ent[i], &lf->ent[i + 1], (lf->h.n - i) * sizeof(lf->ent[0]));
+}
+
+/* append src[from, from + n) to the end of dst */
+static void leaf_move(bpt_leaf_st *dst, bpt_leaf_st *src, uint32_t from, uint32_t n)
+{
+    memcpy(&dst->pfx[dst->h.n], &src->pfx[from], n * sizeof(src->pfx[0]));
+    memcpy(&dst->ent[dst->h.n], &src->ent[from], n * sizeof(src->ent[0]));
+    dst->h.n += n;
+}
+
+static void inner_insert_at(bpt_inner_st *in, uint32_t i, uint64_t pfx, void *key,
+                            uint32_t ksize, bpt_node_st *right)
+{
+    uint32_t n = in->h.n;
+
+    memmove(&in->pfx[i + 1], &in->pfx[i], (n - i) * sizeof(in->pfx[0]));
+    memmove(&in->key[i + 1], &in->key[i], (n - i) * sizeof(in->key[0]));
+    memmove(&in->ksize[i + 1], &in->ksize[i], (n - i) * sizeof(in->ksize[0]));
+    memmove(&in->child[i + 2], &in->child[i + 1], (n - i) * sizeof(in->child[0]));
+    in->pfx[i] = pfx;
+    in->key[i] = key;
+    in->ksize[i] = ksize;
+    in->child[i + 1] = right;
+    in->h.n++;
+}
+
+/* drop separator i and child i + 1; the separator is freed unless it moved elsewhere */
+static void inner_remove_at(bpt_inner_st *in, uint32_t i, int free_key)
+{
+    uint32_t n = --in->h.n;
+
+    if (free_key)
+        free(in->key[i]);
+
+    memmove(&in->pfx[i], &in->pfx[i + 1], (n - i) * sizeof(in->pfx[0]));
+    memmove(&in->key[i], &in->key[i + 1], (n - i) * sizeof(in->key[0]));
+    memmove(&in->ksize[i], &in->ksize[i + 1], (n - i) * sizeof(in->ksize[0]));
+    memmove(&in->child[i + 1], &in->child[i + 2], (n - i) * sizeof(in->child[0]));
+}
+
+static void inner_set_key(bpt_inner_st *in, uint32_t i, uint64_t pfx, const void *key, uint32_t ksize)
+{
+    free(in->key[i]);
+    in->pfx[i] = pfx;
+    in->key[i] = key_dup(key, ksize);
+    in->ksize[i] = ksize;
+}
+
+/*
+ * Insert separator (pfx, key) with 'right' as the child after it into the
+ * parents recorded in path[0, depth), splitting full inner nodes on the way
+ * up and growing a new root if the old one splits.
+ */
+static void insert_up(bptree_st *t, bpt_inner_st **path, uint32_t *idx, int depth,
+                      uint64_t pfx, void *key, uint32_t ksize, bpt_node_st *right)
+{
+    uint64_t tpfx[BPT_INNER_MAX + 1];
+    void *tkey[BPT_INNER_MAX + 1];
+    uint32_t tksize[BPT_INNER_MAX + 1];
+    bpt_node_st *tchild[BPT_INNER_MAX + 2];
+    const uint32_t total = BPT_INNER_MAX + 1, mid = total / 2;
+    bpt_inner_st *root;
+
+    while (depth > 0) {
+        bpt_inner_st *in = path[--depth], *sib;
+        uint32_t i = idx[depth];
+
+        if (in->h.n < BPT_INNER_MAX) {
+            inner_insert_at(in, i, pfx, key, ksize, right);
+            return;
+        }
+
+        /* gather the overfull node, keep [0, mid) here, push key[mid] up */
+        memcpy(tpfx, in->pfx, i * sizeof(tpfx[0]));
+        memcpy(tkey, in->key, i * sizeof(tkey[0]));
+        memcpy(tksize, in->ksize, i * sizeof(tksize[0]));
+        memcpy(tchild, in->child, (i + 1) * sizeof(tchild[0]));
+        tpfx[i] = pfx;
+        tkey[i] = key;
+        tksize[i] = ksize;
+        tchild[i + 1] = right;
+        memcpy(&tpfx[i + 1], &in->pfx[i], (BPT_INNER_MAX - i) * sizeof(tpfx[0]));
+        memcpy(&tkey[i + 1], &in->key[i], (BPT_INNER_MAX - i) * sizeof(tkey[0]));
+        memcpy(&tksize[i + 1], &in->ksize[i], (BPT_INNER_MAX - i) * sizeof(tksize[0]));
+        memcpy(&tchild[i + 2], &in->child[i + 1], (BPT_INNER_MAX - i) * sizeof(tchild[0]));
+
+        sib = node_new(t, 0);
+        in->h.n = mid;
+        memcpy(in->pfx, tpfx, mid * sizeof(tpfx[0]));
+        memcpy(in->key, tkey, mid * sizeof(tkey[0]));
+        memcpy(in->ksize, tksize, mid * sizeof(tksize[0]));
+        memcpy(in->child, tchild, (mid + 1) * sizeof(tchild[0]));
+
+        sib->h.n = total - mid - 1;
+        memcpy(sib->pfx, &tpfx[mid + 1], sib->h.n * sizeof(tpfx[0]));
+        memcpy(sib->key, &tkey[mid + 1], sib->h.n * sizeof(tkey[0]));
+        memcpy(sib->ksize, &tksize[mid + 1], sib->h.n * sizeof(tksize[0]));
+        memcpy(sib->child, &tchild[mid + 1], (sib->h.n + 1) * sizeof(tchild[0]));
+
+        pfx = tpfx[mid];
+        key = tkey[mid];
+        ksize = tksize[mid];
+        right = &sib->h;
+    }
+
+    root = node_new(t, 0);
+    root->h.n = 1;
+    root->pfx[0] = pfx;
+    root->key[0] = key;
+    root->ksize[0] = ksize;
+    root->child[0] = t->root;
+    root->child[1] = right;
+    t->root = &root->h;
+    t->height++;
+}
+
+void bptree_insert(bptree_st *t, const void *key, uint32_t ksize, void *val)
+{
+    bpt_inner_st *path[BPT_MAX_DEPTH];
+    uint32_t idx[BPT_MAX_DEPTH];
+    uint64_t pfx = key_prefix(t, key, ksize);
+    bpt_leaf_st *lf, *right;
+    bptree_cursor_st ent;
+    const uint32_t half = (BPT_LEAF_MAX + 1) / 2;
+    uint32_t i;
+    int depth, eq;
+
+    if (!t->root) {
+        lf = node_new(t, 1);
+        lf->prev = lf->next = NULL;
+        t->root = &lf->h;
+        t->first = t->last = lf;
+        t->height = 1;
+    }
+
+    lf = descend(t, pfx, key, ksize, path, idx, &depth);
+    i = leaf_find(t, lf, pfx, key, ksize, &eq);
+
+    if (eq) {
+        if ((void *)t->data_free)
+            t->data_free(lf->ent[i].data);
+
+        if (t->flag & BFLAG_EXTERN_KEY) {
+            lf->ent[i].key = (void *)key;
+            lf->ent[i].ksize = ksize;
+        }
+        lf->ent[i].data = val;
+        return;
+    }
+
+    ent.key = (t->flag & BFLAG_EXTERN_KEY) ? (void *)key : key_dup(key, ksize);
+    ent.ksize = ksize;
+    ent.data = val;
+    t->nelem++;
+
+    if (lf->h.n < BPT_LEAF_MAX) {
+        leaf_insert_at(lf, i, pfx, &ent);
+        return;
+    }
+
+    /* split the full leaf into two halves, the new entry goes to its side */
+    right = node_new(t, 1);
+    if (i < half) {
+        leaf_move(right, lf, half - 1, BPT_LEAF_MAX - half + 1);
+        lf->h.n = half - 1;
+        leaf_insert_at(lf, i, pfx, &ent);
+    } else {
+        leaf_move(right, lf, half, BPT_LEAF_MAX - half);
+        lf->h.n = half;
+        leaf_insert_at(right, i - half, pfx, &ent);
+    }
+
+    right->prev = lf;
+    right->next = lf->next;
+    if (lf->next)
+        lf->next->prev = right;
+    else
+        t->last = right;
+    lf->next = right;
+
+    insert_up(t, path, idx, depth, right->pfx[0],
+              key_dup(right->ent[0].key, right->ent[0].ksize), right->ent[0].ksize, &right->h);
+}
+
+/* leaf 'lf' at child index ci of 'parent' fell below BPT_LEAF_MIN */
+static void leaf_rebalance(bptree_st *t, bpt_inner_st *parent, uint32_t ci, bpt_leaf_st *lf)
+{
+    bpt_leaf_st *left = ci > 0 ? (bpt_leaf_st *)parent->child[ci - 1] : NULL;
+    bpt_leaf_st *right = ci < parent->h.n ? (bpt_leaf_st *)parent->child[ci + 1] : NULL;
+
+    if (left && left->h.n > BPT_LEAF_MIN) {
+        leaf_insert_at(lf, 0, left->pfx[left->h.n - 1], &left->ent[left->h.n - 1]);
+        left->h.n--;
+        inner_set_key(parent, ci - 1, lf->pfx[0], lf->ent[0].key, lf->ent[0].ksize);
+        return;
+    }
+
+    if (right && right->h.n > BPT_LEAF_MIN) {
+        leaf_move(lf, right, 0, 1);
+        leaf_remove_at(right, 0);
+        inner_set_key(parent, ci, right->pfx[0], right->ent[0].key, right->ent[0].ksize);
+        return;
+    }
+
+    /* merge the right one of the pair into the left one */
+    if (left) {
+        right = lf;
+        ci--;
+    } else {
+        left = lf;
+    }
+
+    leaf_move(left, right, 0, right->h.n);
+    left->next = right->next;
+    if (right->next)
+        right->next->prev = left;
+    else
+        t->last = left;
+
+    inner_remove_at(parent, ci, 1);
+    node_free(t, right);
+}
+
+/* inner node 'in' at child index ci of 'parent' fell below BPT_INNER_MIN, returns 1 if merged */
+static int inner_rebalance(bptree_st *t, bpt_inner_st *parent, uint32_t ci, bpt_inner_st *in)
+{
+    bpt_inner_st *left = ci > 0 ? (bpt_inner_st *)parent->child[ci - 1] : NULL;
+    bpt_inner_st *right = ci < parent->h.n ? (bpt_inner_st *)parent->child[ci + 1] : NULL;
+    uint32_t n;
+
+    if (left && left->h.n > BPT_INNER_MIN) {
+        /* rotate through the parent: its separator comes down, left's last goes up */
+        n = left->h.n;
+        inner_insert_at(in, 0, parent->pfx[ci - 1], parent->key[ci - 1], parent->ksize[ci - 1], in->child[0]);
+        in->child[0] = left->child[n];
+        parent->pfx[ci - 1] = left->pfx[n - 1];
+        parent->key[ci - 1] = left->key[n - 1];
+        parent->ksize[ci - 1] = left->ksize[n - 1];
+        left->h.n--;
+        return 0;
+    }
+
+    if (right && right->h.n > BPT_INNER_MIN) {
+        n = in->h.n;
+        in->pfx[n] = parent->pfx[ci];
+        in->key[n] = parent->key[ci];
+        in->ksize[n] = parent->ksize[ci];
+        in->child[n + 1] = right->child[0];
+        in->h.n++;
+
+        parent->pfx[ci] = right->pfx[0];
+        parent->key[ci] = right->key[0];
+        parent->ksize[ci] = right->ksize[0];
+        right->child[0] = right->child[1];
+        inner_remove_at(right, 0, 0);
+        return 0;
+    }
+
+    if (left) {
+        right = in;
+        ci--;
+    } else {
+        left = in;
+    }
+
+    /* left + separator + right fits: (MIN - 1) + 1 + MIN <= MAX */
+    n = left->h.n;
+    left->pfx[n] = parent->pfx[ci];
+    left->key[n] = parent->key[ci];
+    left->ksize[n] = parent->ksize[ci];
+    memcpy(&left->pfx[n + 1], right->pfx, right->h.n * sizeof(right->pfx[0]));
+    memcpy(&left->key[n + 1], right->key, right->h.n * sizeof(right->key[0]));
+    memcpy(&left->ksize[n + 1], right->ksize, right->h.n * sizeof(right->ksize[0]));
+    memcpy(&left->child[n + 1], right->child, (right->h.n + 1) * sizeof(right->child[0]));
+    left->h.n += 1 + right->h.n;
+
+    inner_remove_at(parent, ci, 0);
+    node_free(t, right);
+    return 1;
+}
+
+void bptree_delete(bptree_st *t, const void *key, uint32_t ksize)
+{
+    bpt_inner_st *path[BPT_MAX_DEPTH];
+    uint32_t idx[BPT_MAX_DEPTH];
+    uint64_t pfx;
+    bpt_leaf_st *lf;
+    uint32_t i;
+    int depth, eq, d;
+
+    if (!t->root)
+        return;
+
+    pfx = key_prefix(t, key, ksize);
+    lf = descend(t, pfx, key, ksize, path, idx, &depth);
+    i = leaf_find(t, lf, pfx, key, ksize, &eq);
+    if (!eq)
+        return;
+
+    if ((void *)t->data_free)
+        t->data_free(lf->ent[i].data);
+    if (!(t->flag & BFLAG_EXTERN_KEY))
+        free(lf->ent[i].key);
+
+    leaf_remove_at(lf, i);
+    t->nelem--;
+
+    if (depth == 0) {
+        if (lf->h.n == 0) {
+            node_free(t, lf);
+            t->root = NULL;
+            t->first = t->last = NULL;
+            t->height = 0;
+        }
+        return;
+    }
+
+    if (lf->h.n >= BPT_LEAF_MIN)
+        return;
+
+    leaf_rebalance(t, path[depth - 1], idx[depth - 1], lf);
+
+    /* merges remove a separator from the parent, which may underflow in turn */
+    for (d = depth - 1; d > 0; d--) {
+        if (path[d]->h.n >= BPT_INNER_MIN)
+            return;
+        if (!inner_rebalance(t, path[d - 1], idx[d - 1], path[d]))
+            return;
+    }
+
+    if (path[0]->h.n == 0) {
+        t->root = path[0]->child[0];
+        node_free(t, path[0]);
+        t->height--;
+    }
+}
+
+static int default_cmp(const void *key1, uint32_t ksize1,
+                       const void *key2, uint32_t ksize2)
+{
+    uint32_t kmin = ksize1 < ksize2 ? ksize1 : ksize2;
+    int res;
+
+    if ((res = memcmp(key1, key2, kmin)))
+        return res;
+
+    return ((int)ksize1 - (int)ksize2);
+}
+
+bptree_st *bptree_create(bptree_data_free_func_t data_free, bptree_cmp_func_t cmp, int flag)
+{
+    bptree_st *t = xmalloc0(sizeof(bptree_st));
+
+    t->flag = flag;
+    t->data_free = data_free;
+    t->cmp_fn = cmp ? cmp : default_cmp;
+    t->use_pfx = cmp == NULL;
+    return t;
+}
+
+static void node_destroy(bptree_st *t, bpt_node_st *node)
+{
+    uint32_t i;
+
+    if (node->leaf) {
+        bpt_leaf_st *lf = (bpt_leaf_st *)node;
+
+        for (i = 0; i < lf->h.n; i++) {
+            if (!(t->flag & BFLAG_EXTERN_KEY))
+                free(lf->ent[i].key);
+            if ((void *)t->data_free)
+                t->data_free(lf->ent[i].data);
+        }
+    } else {
+        bpt_inner_st *in = (bpt_inner_st *)node;
+
+        for (i = 0; i <= in->h.n; i++)
+            node_destroy(t, in->child[i]);
+        for (i = 0; i < in->h.n; i++)
+            free(in->key[i]);
+    }
+
+    node_free(t, node);
+}
+
+void bptree_destroy(bptree_st *t)
+{
+    if (!t)
+        return;
+
+    if (t->root)
+        node_destroy(t, t->root);
+
+    free(t);
+}
+
+uint32_t bptree_count(bptree_st *t)
+{
+    return t->nelem;
+}
+
+int bptree_foreach(bptree_st *t, void *userdata, bptree_foreach_func_t fn)
+{
+    const bptree_cursor_st *cs;
+    int res;
+
+    if (!(void *)fn)
+        return 0;
+
+    for (cs = bptree_first(t); cs; cs = bptree_next(cs)) {
+        if ((res = fn(cs->key, cs->ksize, cs->data, userdata)))
+            return res;
+    }
+
+    return 0;
+}
+
+uint32_t bptree_size(bptree_st *t)
+{
+    return t->nnode * BPT_NODE_SIZE;
+}
+
+#ifdef TEST_BPTREE
+
+#include <time.h>
+
+#include "rbtree.h"
+
+#define UNIVERSE 50000
+#define NKEYS (1 << 20)
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* bytewise like the default comparator, but disables the prefix cache */
+static int plain_cmp(const void *key1, uint32_t ksize1, const void *key2, uint32_t ksize2)
+{
+    int res = memcmp(key1, key2, ksize1 < ksize2 ? ksize1 : ksize2);
+
+    return res ? res : (int)ksize1 - (int)ksize2;
+}
+
+static const void *cs_data(const void *cs, int bpt)
+{
+    if (!cs)
+        return NULL;
+    return bpt ? ((const bptree_cursor_st *)cs)->data : ((const rb_cursor_st *)cs)->data;
+}
+
+/*
+ * Random inserts and deletes checked against an rbtree.  Keys share their
+ * first 8 bytes in runs of 10000, so both the cached prefix and the full
+ * comparison decide orderings; queries also use truncated keys, which sort
+ * before every key they are a prefix of.
+ */
+static int model_check(bptree_cmp_func_t cmp, int flag)
+{
+    static char keys[UNIVERSE][16];
+    bptree_st *t = bptree_create(NULL, cmp, flag);
+    rbtree_st *ref = rbtree_create(NULL, NULL, 0);
+    unsigned seed = 1;
+
+    for (int i = 0; i < UNIVERSE; i++)
+        snprintf(keys[i], sizeof(keys[i]), "key:%08d", i);
+
+    for (int op = 0; op < 400000; op++) {
+        int i = rand_r(&seed) % UNIVERSE;
+        uint32_t n = 12;
+
+        /* grow to a few leaf splits deep, then shrink back to empty */
+        if (rand_r(&seed) % 100 < (op / 100000 % 2 ? 30 : 70)) {
+            bptree_insert(t, keys[i], n, (void *)(uintptr_t)(i + 1));
+            rbtree_insert(ref, keys[i], n, (void *)(uintptr_t)(i + 1));
+        } else {
+            bptree_delete(t, keys[i], n);
+            rbtree_delete(ref, keys[i], n);
+        }
+
+        if (bptree_count(t) != rbtree_count(ref))
+            return printf("FAIL count after op %d\n", op), 1;
+
+        i = rand_r(&seed) % UNIVERSE;
+        n = 6 + rand_r(&seed) % 7;
+        if (cs_data(bptree_lower_bound(t, keys[i], n), 1) != cs_data(rbtree_lower_bound(ref, keys[i], n), 0) ||
+            cs_data(bptree_upper_bound(t, keys[i], n), 1) != cs_data(rbtree_upper_bound(ref, keys[i], n), 0) ||
+            cs_data(bptree_get_cursor(t, keys[i], n), 1) != cs_data(rbtree_get_cursor(ref, keys[i], n), 0))
+            return printf("FAIL bounds of %.*s after op %d\n", (int)n, keys[i], op), 1;
+
+        /* step a few entries both ways from the lower bound */
+        const bptree_cursor_st *bc = bptree_lower_bound(t, keys[i], n);
+        const rb_cursor_st *rc = rbtree_lower_bound(ref, keys[i], n);
+        for (int s = 0; s < 40 && bc; s++) {
+            if (cs_data(bc, 1) != cs_data(rc, 0))
+                return printf("FAIL walk from %.*s after op %d\n", (int)n, keys[i], op), 1;
+            if (s < 20) {
+                bc = bptree_next(bc);
+                rc = rbtree_next(rc);
+            } else {
+                bc = bptree_prev(bc);
+                rc = rbtree_prev(rc);
+            }
+        }
+        if (cs_data(bc, 1) != cs_data(rc, 0))
+            return printf("FAIL walk end from %.*s after op %d\n", (int)n, keys[i], op), 1;
+    }
+
+    /* a full walk in both directions, then drain */
+    const bptree_cursor_st *bc = bptree_first(t);
+    const rb_cursor_st *rc = rbtree_first(ref);
+    for (; bc || rc; bc = bptree_next(bc), rc = rbtree_next(rc)) {
+        if (!bc || !rc || bc->data != rc->data)
+            return printf("FAIL forward walk\n"), 1;
+    }
+    bc = bptree_last(t);
+    rc = rbtree_last(ref);
+    for (; bc || rc; bc = bptree_prev(bc), rc = rbtree_prev(rc)) {
+        if (!bc || !rc || bc->data != rc->data)
+            return printf("FAIL backward walk\n"), 1;
+    }
+
+    for (int i = 0; i < UNIVERSE; i++)
+        bptree_delete(t, keys[i], 12);
+    if (bptree_count(t) != 0 || bptree_first(t) || bptree_size(t) > BPT_NODE_SIZE)
+        return printf("FAIL drain leaves %u entries, %u bytes\n", bptree_count(t), bptree_size(t)), 1;
+
+    bptree_destroy(t);
+    rbtree_destroy(ref);
+    return 0;
+}
+
+/* 1M random 15-digit keys, the same operations on a pooled rbtree and a bptree */
+int main(void)
+{
+    static char keys[NKEYS][16];
+    unsigned long long x = 88172645463325252ULL;
+    double t0, t1, t2;
+    size_t hits = 0, sum[2] = {0, 0};
+
+    if (model_check(NULL, 0) || model_check(plain_cmp, 0) || model_check(NULL, BFLAG_EXTERN_KEY))
+        return 1;
+
+    for (int i = 0; i < NKEYS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(keys[i], sizeof(keys[i]), "%015llu", x % 1000000000000000ULL);
+    }
+
+    rbtree_st *rb = rbtree_create(NULL, NULL, RFLAG_NODE_POOL);
+    bptree_st *bt = bptree_create(NULL, NULL, 0);
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        rbtree_insert(rb, keys[i], 15, NULL);
+    t1 = now();
+    for (int i = 0; i < NKEYS; i++)
+        bptree_insert(bt, keys[i], 15, NULL);
+    t2 = now();
+    printf("insert:      rbtree %6.0f ns  bptree %6.0f ns\n", (t1 - t0) * 1e9 / NKEYS, (t2 - t1) * 1e9 / NKEYS);
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits += rbtree_search(rb, keys[(i * 7919L) % NKEYS], 15, NULL) == 0;
+    t1 = now();
+    for (int i = 0; i < NKEYS; i++)
+        hits += bptree_search(bt, keys[(i * 7919L) % NKEYS], 15, NULL) == 0;
+    t2 = now();
+    printf("search:      rbtree %6.0f ns  bptree %6.0f ns (%s)\n", (t1 - t0) * 1e9 / NKEYS,
+           (t2 - t1) * 1e9 / NKEYS, hits == 2 * NKEYS ? "ok" : "MISMATCH");
+
+    /* lower_bound, then 100 steps of next */
+    t0 = now();
+    for (int i = 0; i < 20000; i++) {
+        const rb_cursor_st *cs = rbtree_lower_bound(rb, keys[i], 15);
+        for (int j = 0; j < 100 && cs; j++, cs = rbtree_next(cs))
+            sum[0] += cs->key != NULL;
+    }
+    t1 = now();
+    for (int i = 0; i < 20000; i++) {
+        const bptree_cursor_st *cs = bptree_lower_bound(bt, keys[i], 15);
+        for (int j = 0; j < 100 && cs; j++, cs = bptree_next(cs))
+            sum[1] += cs->key != NULL;
+    }
+    t2 = now();
+    printf("scan of 100: rbtree %6.0f ns  bptree %6.0f ns (%s)\n", (t1 - t0) * 1e9 / 20000,
+           (t2 - t1) * 1e9 / 20000, sum[0] == sum[1] ? "ok" : "MISMATCH");
+
+    printf("memory:      rbtree %u bytes  bptree %u bytes\n", rbtree_size(rb), bptree_size(bt));
+
+    t0 = now();
+    for (int i = 0; i < NKEYS; i++)
+        rbtree_delete(rb, keys[i], 15);
+    t1 = now();
+    for (int i = 0; i < NKEYS; i++)
+        bptree_delete(bt, keys[i], 15);
+    t2 = now();
+    printf("delete:      rbtree %6.0f ns  bptree %6.0f ns\n", (t1 - t0) * 1e9 / NKEYS, (t2 - t1) * 1e9 / NKEYS);
+
+    rbtree_destroy(rb);
+    bptree_destroy(bt);
+    return 0;
+}
+#endif /* TEST_BPTREE */
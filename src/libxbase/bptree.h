@@ -0,0 +1,194 @@
+/**
+ * @file bptree.h
+ * @brief B+tree: an ordered map with the rbtree cursor API
+ *
+ * Nodes are BPT_NODE_SIZE bytes, so a lookup costs a few cache misses per
+ * level instead of one per binary level.  Entries live only in the leaves,
+ * which are linked in key order for range scans.  With the default
+ * comparator every entry and separator also caches the first 8 key bytes
+ * as an integer, and most comparisons are decided without touching the key.
+ *
+ * Unlike rbtree cursors, a cursor points into a leaf and is invalidated by
+ * any insert or delete on the tree.
+ */
+
+#ifndef __BPTREE_H__
+#define __BPTREE_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Size in bytes of every node; leaves are aligned to it
+ */
+#define BPT_NODE_SIZE 1024
+
+/**
+ * @brief Structure representing a B+tree
+ */
+struct bptree_st;
+typedef struct bptree_st bptree_st;
+
+/**
+ * @brief Function pointer type for comparing two keys
+ * @param key1 Pointer to the first key
+ * @param ksize1 Size of the first key
+ * @param key2 Pointer to the second key
+ * @param ksize2 Size of the second key
+ * @return An integer less than, equal to, or greater than zero if the first
+ *         key is less than, equal to, or greater than the second key
+ */
+typedef int (*bptree_cmp_func_t)(const void *key1, uint32_t ksize1,
+                                 const void *key2, uint32_t ksize2);
+
+/**
+ * @brief Function pointer type for freeing data associated with a key
+ * @param data Pointer to the data to be freed
+ */
+typedef void (*bptree_data_free_func_t)(void *data);
+
+/**
+ * @brief Flag indicating that the tree should reference keys instead of copying them
+ */
+#define BFLAG_EXTERN_KEY 0x1
+
+/**
+ * @brief Structure representing a cursor for iterating over a tree,
+ *        laid out like rb_cursor_st
+ */
+typedef struct bptree_cursor_st {
+    void *key;      /**< Pointer to the key */
+    uint32_t ksize; /**< Size of the key */
+    void *data;     /**< Pointer to the data */
+} bptree_cursor_st;
+
+/**
+ * @brief Create a new B+tree
+ * @param data_free Function pointer for freeing data associated with a key
+ * @param cmp Function pointer for comparing two keys, NULL for bytewise order
+ * @param flag Flag indicating whether to use external memory for keys
+ * @return Pointer to the newly created tree
+ */
+bptree_st *bptree_create(bptree_data_free_func_t data_free, bptree_cmp_func_t cmp, int flag);
+
+/**
+ * @brief Destroy a tree and free all associated memory
+ * @param t Pointer to the tree to be destroyed
+ */
+void bptree_destroy(bptree_st *t);
+
+/**
+ * @brief Get the number of keys in a tree
+ * @param t Pointer to the tree
+ * @return The number of keys in the tree
+ */
+uint32_t bptree_count(bptree_st *t);
+
+/**
+ * @brief Get the cursor for the smallest key
+ * @param t Pointer to the tree
+ * @return Pointer to the cursor, or NULL if the tree is empty
+ */
+const bptree_cursor_st *bptree_first(const bptree_st *t);
+
+/**
+ * @brief Get the cursor for the largest key
+ * @param t Pointer to the tree
+ * @return Pointer to the cursor, or NULL if the tree is empty
+ */
+const bptree_cursor_st *bptree_last(const bptree_st *t);
+
+/**
+ * @brief Get the cursor for the next key
+ * @param itor Pointer to the cursor for the current key
+ * @return Pointer to the cursor for the next key, or NULL if there is no next key
+ */
+const bptree_cursor_st *bptree_next(const bptree_cursor_st *itor);
+
+/**
+ * @brief Get the cursor for the previous key
+ * @param itor Pointer to the cursor for the current key
+ * @return Pointer to the cursor for the previous key, or NULL if there is no previous key
+ */
+const bptree_cursor_st *bptree_prev(const bptree_cursor_st *itor);
+
+/**
+ * @brief Search for a key and return its value
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @param val Pointer to a variable to store the value, or NULL if the value is not needed
+ * @return 0 if the key is found, -1 otherwise
+ */
+int bptree_search(const bptree_st *t, const void *key, uint32_t ksize, void **val);
+
+/**
+ * @brief Search for a key and return its cursor
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if the key is not found
+ */
+const bptree_cursor_st *bptree_get_cursor(const bptree_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Search for the first key greater than or equal to a given key
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if there is no such key
+ */
+const bptree_cursor_st *bptree_lower_bound(const bptree_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Search for the last key less than or equal to a given key
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to search for
+ * @param ksize Size of the key
+ * @return Pointer to the cursor, or NULL if there is no such key
+ */
+const bptree_cursor_st *bptree_upper_bound(const bptree_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Insert a key and value, replacing the value if the key exists
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to insert
+ * @param ksize Size of the key
+ * @param val Pointer to the value to insert
+ */
+void bptree_insert(bptree_st *t, const void *key, uint32_t ksize, void *val);
+
+/**
+ * @brief Delete a key from the tree
+ * @param t Pointer to the tree
+ * @param key Pointer to the key to delete
+ * @param ksize Size of the key
+ */
+void bptree_delete(bptree_st *t, const void *key, uint32_t ksize);
+
+/**
+ * @brief Function pointer type for iterating over a tree
+ * @param key Pointer to the key
+ * @param ksize Size of the key
+ * @param val Pointer to the value
+ * @param userdata Pointer to user-defined data
+ * @return A non-zero value to stop iterating and return that value from bptree_foreach()
+ */
+typedef int (*bptree_foreach_func_t)(const void *key, int ksize, void *val, void *userdata);
+
+/**
+ * @brief Iterate over the tree in key order
+ * @param t Pointer to the tree
+ * @param userdata Pointer to user-defined data to pass to the function
+ * @param fn Function to call for each key
+ * @return 0 if the iteration completes, or the non-zero value returned by fn
+ */
+int bptree_foreach(bptree_st *t, void *userdata, bptree_foreach_func_t fn);
+
+/**
+ * @brief Get the memory used by the tree's nodes, not including keys and values
+ * @param t Pointer to the tree
+ * @return The size of the tree in bytes
+ */
+uint32_t bptree_size(bptree_st *t);
+
+#endif
@@ -0,0 +1,742 @@
+#include "ctrie.h"
+#include "xmalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* 节点发布后只读，子节点按 token 排序，token 与子节点数组在同一块内存里 */
+struct cnode {
+    void *udata;
+    const char *token;
+    uint32_t toklen;
+    uint32_t nchild;
+    struct cnode *childs[];
+};
+
+/* 读者的 epoch 为 0 表示不在临界区内，每个读者按缓存行对齐分配，避免读者之间伪共享 */
+struct ctrie_reader {
+    uint64_t epoch;
+    int used;
+    ctrie_t *ct;
+    struct ctrie_reader *next;
+} __attribute__((aligned(64)));
+
+struct retired {
+    void *ptr;
+    ctrie_free_fn_t fn;
+    uint64_t epoch;
+};
+
+struct ctrie {
+    struct cnode *root;
+    uint64_t epoch;
+
+    pthread_mutex_t lock;
+    struct ctrie_reader *readers;
+
+    struct retired *retired;
+    size_t nretired, cap;
+
+    ctrie_free_fn_t ufree;
+};
+
+static struct cnode *cnode_new(const char *token, uint32_t toklen, uint32_t nchild, void *udata)
+{
+    size_t size = sizeof(struct cnode) + nchild * sizeof(struct cnode *);
+    struct cnode *node = xmalloc(size + toklen + 1);
+    char *tok = (char *)node + size;
+
+    memcpy(tok, token, toklen);
+    tok[toklen] = '\0';
+
+    node->udata = udata;
+    node->token = tok;
+    node->toklen = toklen;
+    node->nchild = nchild;
+
+    return node;
+}
+
+static int cnode_cmp(const struct cnode *node, const char *seg, uint32_t len)
+{
+    uint32_t n = node->toklen < len ? node->toklen : len;
+    int res = memcmp(node->token, seg, n);
+
+    return res ? res : (int)node->toklen - (int)len;
+}
+
+/* 二分查找，返回 seg 所在或应当插入的位置 */
+static uint32_t cnode_find(const struct cnode *node, const char *seg, uint32_t len, int *found)
+{
+    uint32_t lo = 0, hi = node->nchild;
+
+    *found = 0;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int res = cnode_cmp(node->childs[mid], seg, len);
+
+        if (res == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (res < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static uint32_t ctrie_segment(const char *rem, int *last)
+{
+    const char *end = strchr(rem, '/');
+
+    *last = end == NULL;
+    return end ? (uint32_t)(end - rem) : (uint32_t)strlen(rem);
+}
+
+/* 写者持锁时调用，ptr 在当前 epoch 的读者都离开后释放 */
+static void ctrie_retire(ctrie_t *ct, void *ptr, ctrie_free_fn_t fn)
+{
+    if (ct->nretired == ct->cap) {
+        ct->cap = ct->cap ? ct->cap * 2 : 64;
+        ct->retired = xrealloc(ct->retired, ct->cap * sizeof(struct retired));
+    }
+
+    ct->retired[ct->nretired].ptr = ptr;
+    ct->retired[ct->nretired].fn = fn;
+    ct->retired[ct->nretired].epoch = ct->epoch;
+    ct->nretired++;
+}
+
+static void ctrie_free_node(void *ptr)
+{
+    free(ptr);
+}
+
+static void ctrie_retire_node(ctrie_t *ct, struct cnode *node)
+{
+    ctrie_retire(ct, node, ctrie_free_node);
+}
+
+static void ctrie_retire_data(ctrie_t *ct, void *udata)
+{
+    if (udata && ct->ufree)
+        ctrie_retire(ct, udata, ct->ufree);
+}
+
+static void ctrie_retire_tree(ctrie_t *ct, struct cnode *node)
+{
+    for (uint32_t i = 0; i < node->nchild; i++)
+        ctrie_retire_tree(ct, node->childs[i]);
+
+    ctrie_retire_data(ct, node->udata);
+    ctrie_retire_node(ct, node);
+}
+
+/* 释放所有读者都已经看不到的节点：读者在 epoch e 进入后只能看到 e 之后退休的节点 */
+static void ctrie_reclaim(ctrie_t *ct)
+{
+    uint64_t min = UINT64_MAX;
+    size_t i, n = 0;
+
+    for (struct ctrie_reader *r = ct->readers; r; r = r->next) {
+        uint64_t e = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+        if (e && e < min)
+            min = e;
+    }
+
+    for (i = 0; i < ct->nretired; i++) {
+        struct retired *rt = &ct->retired[i];
+
+        if (rt->epoch < min)
+            rt->fn(rt->ptr);
+        else
+            ct->retired[n++] = *rt;
+    }
+
+    ct->nretired = n;
+}
+
+/* 发布新的根节点后推进 epoch 并回收 */
+static void ctrie_publish(ctrie_t *ct, struct cnode *root)
+{
+    __atomic_store_n(&ct->root, root, __ATOMIC_RELEASE);
+    __atomic_store_n(&ct->epoch, ct->epoch + 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    ctrie_reclaim(ct);
+}
+
+ctrie_t *ctrie_new(ctrie_free_fn_t ufree)
+{
+    ctrie_t *ct = xnew0(ctrie_t);
+
+    ct->root = cnode_new("", 0, 0, NULL);
+    ct->epoch = 1;
+    pthread_mutex_init(&ct->lock, NULL);
+    ct->ufree = ufree;
+
+    return ct;
+}
+
+static void ctrie_destroy_tree(ctrie_t *ct, struct cnode *node)
+{
+    for (uint32_t i = 0; i < node->nchild; i++)
+        ctrie_destroy_tree(ct, node->childs[i]);
+
+    if (node->udata && ct->ufree)
+        ct->ufree(node->udata);
+    xfree(node);
+}
+
+void ctrie_free(ctrie_t *ct)
+{
+    if (!ct)
+        return;
+
+    for (size_t i = 0; i < ct->nretired; i++)
+        ct->retired[i].fn(ct->retired[i].ptr);
+    xfree(ct->retired);
+
+    ctrie_destroy_tree(ct, ct->root);
+
+    while (ct->readers) {
+        struct ctrie_reader *r = ct->readers;
+        ct->readers = r->next;
+        xfree(r);
+    }
+
+    pthread_mutex_destroy(&ct->lock);
+    xfree(ct);
+}
+
+ctrie_reader_t *ctrie_reader_new(ctrie_t *ct)
+{
+    struct ctrie_reader *r;
+
+    pthread_mutex_lock(&ct->lock);
+
+    for (r = ct->readers; r; r = r->next) {
+        if (!r->used)
+            break;
+    }
+
+    if (r == NULL) {
+        r = aligned_alloc(64, sizeof(struct ctrie_reader));
+        if (!r) {
+            fprintf(stderr, "aligned_alloc: failed to allocate %zu bytes,memory exhausted.",
+                    sizeof(struct ctrie_reader));
+            exit(1);
+        }
+        memset(r, 0, sizeof(*r));
+        r->ct = ct;
+        r->next = ct->readers;
+        ct->readers = r;
+    }
+    r->used = 1;
+
+    pthread_mutex_unlock(&ct->lock);
+    return r;
+}
+
+void ctrie_reader_free(ctrie_reader_t *reader)
+{
+    ctrie_t *ct = reader->ct;
+
+    pthread_mutex_lock(&ct->lock);
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    reader->used = 0;
+    pthread_mutex_unlock(&ct->lock);
+}
+
+void ctrie_read_enter(ctrie_reader_t *reader)
+{
+    uint64_t e = __atomic_load_n(&reader->ct->epoch, __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(&reader->epoch, e, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void ctrie_read_leave(ctrie_reader_t *reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+void *ctrie_search(ctrie_t *ct, const char *path)
+{
+    struct cnode *node = __atomic_load_n(&ct->root, __ATOMIC_ACQUIRE);
+    const char *rem = path + 1;
+
+    for (;;) {
+        int last, found;
+        uint32_t len = ctrie_segment(rem, &last);
+        uint32_t idx = cnode_find(node, rem, len, &found);
+
+        if (!found)
+            return NULL;
+
+        node = node->childs[idx];
+        if (last)
+            return node->udata;
+
+        rem += len + 1;
+    }
+}
+
+void *ctrie_longest_prefix(ctrie_t *ct, const char *path, size_t *matched_len)
+{
+    struct cnode *node = __atomic_load_n(&ct->root, __ATOMIC_ACQUIRE);
+    const char *rem = path + 1;
+    void *best = NULL;
+
+    *matched_len = 0;
+
+    for (;;) {
+        int last, found;
+        uint32_t len = ctrie_segment(rem, &last);
+        uint32_t idx = cnode_find(node, rem, len, &found);
+
+        if (!found)
+            break;
+
+        node = node->childs[idx];
+        if (node->udata) {
+            best = node->udata;
+            *matched_len = (size_t)(rem + len - path);
+        }
+        if (last)
+            break;
+
+        rem += len + 1;
+    }
+
+    return best;
+}
+
+/* 为 rem 中剩余的各段构造一条新链，数据放在最后一个节点上 */
+static struct cnode *ctrie_chain(const char *rem, void *udata)
+{
+    int last;
+    uint32_t len = ctrie_segment(rem, &last);
+
+    if (last)
+        return cnode_new(rem, len, 0, udata);
+
+    struct cnode *node = cnode_new(rem, len, 1, NULL);
+    node->childs[0] = ctrie_chain(rem + len + 1, udata);
+    return node;
+}
+
+/* 复制 node 并在 idx 处替换(replace 为真)或插入子节点 */
+static struct cnode *cnode_with_child(const struct cnode *node, uint32_t idx, struct cnode *child, int replace)
+{
+    uint32_t n = node->nchild + !replace;
+    struct cnode *copy = cnode_new(node->token, node->toklen, n, node->udata);
+
+    memcpy(copy->childs, node->childs, idx * sizeof(struct cnode *));
+    copy->childs[idx] = child;
+    memcpy(copy->childs + idx + 1, node->childs + idx + replace,
+           (node->nchild - idx - replace) * sizeof(struct cnode *));
+
+    return copy;
+}
+
+static struct cnode *ctrie_cow_insert(ctrie_t *ct, struct cnode *node, const char *rem, void *udata, int *replaced)
+{
+    int last, found;
+    uint32_t len = ctrie_segment(rem, &last);
+    uint32_t idx = cnode_find(node, rem, len, &found);
+    struct cnode *child;
+
+    if (!found) {
+        child = ctrie_chain(rem, udata);
+    } else if (last) {
+        struct cnode *old = node->childs[idx];
+
+        child = cnode_new(old->token, old->toklen, old->nchild, udata);
+        memcpy(child->childs, old->childs, old->nchild * sizeof(struct cnode *));
+
+        if (old->udata != udata)
+            ctrie_retire_data(ct, old->udata);
+        ctrie_retire_node(ct, old);
+        *replaced = old->udata != NULL;
+    } else {
+        child = ctrie_cow_insert(ct, node->childs[idx], rem + len + 1, udata, replaced);
+    }
+
+    ctrie_retire_node(ct, node);
+    return cnode_with_child(node, idx, child, found);
+}
+
+int ctrie_insert(ctrie_t *ct, const char *path, void *data)
+{
+    int replaced = 0;
+
+    pthread_mutex_lock(&ct->lock);
+    ctrie_publish(ct, ctrie_cow_insert(ct, ct->root, path + 1, data, &replaced));
+    pthread_mutex_unlock(&ct->lock);
+
+    return replaced;
+}
+
+/* 复制 node 并去掉 idx 处的子节点 */
+static struct cnode *cnode_without_child(const struct cnode *node, uint32_t idx)
+{
+    struct cnode *copy = cnode_new(node->token, node->toklen, node->nchild - 1, node->udata);
+
+    memcpy(copy->childs, node->childs, idx * sizeof(struct cnode *));
+    memcpy(copy->childs + idx, node->childs + idx + 1, (node->nchild - idx - 1) * sizeof(struct cnode *));
+
+    return copy;
+}
+
+/*
+ * 路径不存在时返回 NULL，不复制任何节点。
+ * 删除后没有数据也没有子节点的祖先节点一并去掉，与 trie_node_remove 一样。
+ */
+static struct cnode *ctrie_cow_remove(ctrie_t *ct, struct cnode *node, const char *rem)
+{
+    int last, found;
+    uint32_t len = ctrie_segment(rem, &last);
+    uint32_t idx = cnode_find(node, rem, len, &found);
+    struct cnode *copy;
+
+    if (!found)
+        return NULL;
+
+    if (last) {
+        copy = cnode_without_child(node, idx);
+        ctrie_retire_tree(ct, node->childs[idx]);
+    } else {
+        struct cnode *child = ctrie_cow_remove(ct, node->childs[idx], rem + len + 1);
+        if (child == NULL)
+            return NULL;
+
+        /* child 是尚未发布的副本，可以直接释放 */
+        if (child->nchild == 0 && child->udata == NULL) {
+            xfree(child);
+            copy = cnode_without_child(node, idx);
+        } else {
+            copy = cnode_with_child(node, idx, child, 1);
+        }
+    }
+
+    ctrie_retire_node(ct, node);
+    return copy;
+}
+
+int ctrie_remove(ctrie_t *ct, const char *path)
+{
+    struct cnode *root;
+
+    pthread_mutex_lock(&ct->lock);
+
+    root = ctrie_cow_remove(ct, ct->root, path + 1);
+    if (root)
+        ctrie_publish(ct, root);
+
+    pthread_mutex_unlock(&ct->lock);
+
+    return root ? 0 : -1;
+}
+
+#ifdef TEST_CTRIE
+
+#include <time.h>
+#include <sched.h>
+
+#include "trie.h"
+
+#define ROUTES 4096
+#define STABLE 1024 /* 前 STABLE 条路由只替换数据，不删除 */
+#define ROUTE_MAGIC 0x726f757465ULL
+
+struct route {
+    uint64_t magic;
+    size_t id;
+};
+
+static char paths[ROUTES][40];
+static ctrie_t *ctrie;
+static trie_node_t *trie;
+static pthread_mutex_t trie_lock = PTHREAD_MUTEX_INITIALIZER;
+static int stop;
+static size_t lookups, writes, nbad;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct route *route_new(size_t id)
+{
+    struct route *rt = xnew(struct route);
+
+    rt->magic = ROUTE_MAGIC;
+    rt->id = id;
+    return rt;
+}
+
+/* 释放前清掉 magic，读者读到已释放的数据时校验失败 */
+static void route_free(void *data)
+{
+    ((struct route *)data)->magic = 0;
+    free(data);
+}
+
+static int route_ok(const struct route *rt, size_t id)
+{
+    return rt && rt->magic == ROUTE_MAGIC && rt->id == id;
+}
+
+/*
+ * 前 64 条是两段的 /svcA/vB，其余是三段的 /svcA/vB/rC。
+ * 第 k 条三段路由的前两段就是第 k % 64 条路由，它也可能只作为中间节点存在
+ */
+static void paths_init(void)
+{
+    for (size_t k = 0; k < ROUTES; k++) {
+        if (k < 64)
+            snprintf(paths[k], sizeof(paths[k]), "/svc%zu/v%zu", k % 16, k / 16);
+        else
+            snprintf(paths[k], sizeof(paths[k]), "/svc%zu/v%zu/r%zu", k % 16, (k / 16) % 4, k);
+    }
+}
+
+static int is_prefix(const char *prefix, const char *path)
+{
+    size_t n = strlen(prefix);
+
+    return strncmp(prefix, path, n) == 0 && (path[n] == '\0' || path[n] == '/');
+}
+
+/* 单线程随机插入删除，与记录哪些路由存在的数组对照 */
+static int model_check(void)
+{
+    ctrie_t *ct = ctrie_new(route_free);
+    ctrie_reader_t *rd = ctrie_reader_new(ct);
+    static char present[ROUTES];
+    unsigned seed = 1;
+
+    for (int i = 0; i < 200000; i++) {
+        size_t k = rand_r(&seed) % ROUTES;
+
+        if (rand_r(&seed) % 2) {
+            if (ctrie_insert(ct, paths[k], route_new(k)) != present[k])
+                return printf("FAIL insert %s\n", paths[k]), 1;
+            present[k] = 1;
+        } else {
+            /* 删除后不留空的中间节点，所以只有存在以 k 为前缀的路由时才能删除成功 */
+            int exist = 0;
+
+            for (size_t j = 0; j < ROUTES; j++) {
+                if (present[j] && is_prefix(paths[k], paths[j])) {
+                    exist = 1;
+                    present[j] = 0;
+                }
+            }
+            if (ctrie_remove(ct, paths[k]) != (exist ? 0 : -1))
+                return printf("FAIL remove %s\n", paths[k]), 1;
+        }
+
+        k = rand_r(&seed) % ROUTES;
+        size_t best = present[k] ? k : k >= 64 && present[k % 64] ? k % 64 : ROUTES, matched;
+
+        ctrie_read_enter(rd);
+        struct route *rt = ctrie_search(ct, paths[k]);
+        struct route *lp = ctrie_longest_prefix(ct, paths[k], &matched);
+        ctrie_read_leave(rd);
+        if (present[k] ? !route_ok(rt, k) : rt != NULL)
+            return printf("FAIL search %s\n", paths[k]), 1;
+        if (best < ROUTES ? !route_ok(lp, best) || matched != strlen(paths[best]) : lp != NULL)
+            return printf("FAIL longest prefix %s\n", paths[k]), 1;
+    }
+
+    for (size_t k = 0; k < ROUTES; k++)
+        ctrie_remove(ct, paths[k]);
+    if (ct->root->nchild != 0)
+        return printf("FAIL %u nodes left after draining\n", ct->root->nchild), 1;
+
+    ctrie_reader_free(rd);
+    ctrie_free(ct);
+    return 0;
+}
+
+static void *ctrie_reader_main(void *arg)
+{
+    ctrie_reader_t *rd = ctrie_reader_new(ctrie);
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    size_t n = 0, bad = 0;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        ctrie_read_enter(rd);
+        for (int i = 0; i < 64; i++, n++) {
+            size_t k = rand_r(&seed) % ROUTES;
+            struct route *rt = ctrie_search(ctrie, paths[k]);
+
+            if (k < STABLE ? !route_ok(rt, k) : rt && !route_ok(rt, k))
+                bad++;
+        }
+        ctrie_read_leave(rd);
+    }
+
+    ctrie_reader_free(rd);
+    __atomic_fetch_add(&lookups, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&nbad, bad, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* 写线程每次修改后暂停 WRITE_INTERVAL 纳秒，模拟配置变更而不是让写者占满一个核 */
+#define WRITE_INTERVAL 20000
+
+static void write_pause(void)
+{
+    struct timespec ts = {0, WRITE_INTERVAL};
+    nanosleep(&ts, NULL);
+}
+
+/* 替换稳定路由的数据，增删其余路由 */
+static void *ctrie_writer_main(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    size_t n = 0;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        size_t k = rand_r(&seed) % ROUTES;
+
+        if (k < STABLE || rand_r(&seed) % 2)
+            ctrie_insert(ctrie, paths[k], route_new(k));
+        else
+            ctrie_remove(ctrie, paths[k]);
+        n++;
+        write_pause();
+    }
+
+    writes = n;
+    return NULL;
+}
+
+/* 对照：现在的做法，trie.c 加一把全局锁 */
+static void trie_route_set(const char *path, struct route *rt)
+{
+    trie_node_t *node = trie_node_insert(trie, path);
+    struct route *old;
+
+    if (node == NULL)
+        node = trie_node_search(trie, path);
+
+    /* trie_node_set_data 不释放旧数据 */
+    old = trie_node_get_data(node);
+    trie_node_set_data(node, rt, route_free);
+    if (old)
+        route_free(old);
+}
+
+static void *trie_reader_main(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    size_t n = 0, bad = 0;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        for (int i = 0; i < 64; i++, n++) {
+            size_t k = rand_r(&seed) % ROUTES;
+
+            pthread_mutex_lock(&trie_lock);
+            trie_node_t *node = trie_node_search(trie, paths[k]);
+            struct route *rt = node ? trie_node_get_data(node) : NULL;
+            if (k < STABLE ? !route_ok(rt, k) : rt && !route_ok(rt, k))
+                bad++;
+            pthread_mutex_unlock(&trie_lock);
+        }
+    }
+
+    __atomic_fetch_add(&lookups, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&nbad, bad, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *trie_writer_main(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    size_t n = 0;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        size_t k = rand_r(&seed) % ROUTES;
+
+        pthread_mutex_lock(&trie_lock);
+        if (k < STABLE || rand_r(&seed) % 2)
+            trie_route_set(paths[k], route_new(k));
+        else
+            trie_node_remove(trie, paths[k]);
+        pthread_mutex_unlock(&trie_lock);
+        n++;
+        write_pause();
+    }
+
+    writes = n;
+    return NULL;
+}
+
+/* nreader 个读线程和一个持续改路由的写线程运行 secs 秒，返回每秒查找次数 */
+static double run(void *(*reader)(void *), void *(*writer)(void *), int nreader, double secs)
+{
+    pthread_t tids[65];
+    double t0, t1;
+
+    lookups = writes = 0;
+    __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+
+    t0 = now();
+    pthread_create(&tids[0], NULL, writer, (void *)(uintptr_t)1);
+    for (int i = 1; i <= nreader; i++)
+        pthread_create(&tids[i], NULL, reader, (void *)(uintptr_t)(i + 1));
+
+    while (now() - t0 < secs)
+        sched_yield();
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+    for (int i = 0; i <= nreader; i++)
+        pthread_join(tids[i], NULL);
+    t1 = now();
+
+    return lookups / (t1 - t0);
+}
+
+int main(void)
+{
+    paths_init();
+
+    if (model_check())
+        return 1;
+
+    ctrie = ctrie_new(route_free);
+    trie = trie_node_new();
+    for (size_t k = 0; k < STABLE; k++) {
+        ctrie_insert(ctrie, paths[k], route_new(k));
+        trie_route_set(paths[k], route_new(k));
+    }
+
+    for (int n = 1; n <= 16; n *= 2) {
+        double c = run(ctrie_reader_main, ctrie_writer_main, n, 0.5);
+        size_t cw = writes;
+        double m = run(trie_reader_main, trie_writer_main, n, 0.5);
+
+        printf("readers %2d: ctrie %6.2f M lookups/s (%zu writes)  mutex trie %6.2f M lookups/s (%zu writes)\n",
+               n, c / 1e6, cw, m / 1e6, writes);
+    }
+
+    ctrie_free(ctrie);
+    trie_node_delete(trie);
+
+    if (nbad)
+        return printf("FAIL %zu bad lookups\n", nbad), 1;
+    return 0;
+}
+#endif /* TEST_CTRIE */
@@ -0,0 +1,106 @@
+/**
+ * @file ctrie.h
+ * @brief 支持并发读的写时复制trie树
+ *
+ * 节点发布后不再修改。写者(互相之间用互斥锁串行)复制从根到修改位置的路径，
+ * 再原子地发布新的根节点；读者不加锁，也不做原子读改写，只在进入和离开
+ * 读临界区时写自己的epoch。被替换下来的节点和用户数据按epoch延迟释放，
+ * 直到所有可能看到它们的读者都已离开。
+ *
+ * 路径的分段规则与 trie.h 相同，不支持参数段和通配段。
+ */
+
+#ifndef CTRIE_H
+#define CTRIE_H
+
+#include <stddef.h>
+
+/**
+ * @brief 并发trie树
+ */
+typedef struct ctrie ctrie_t;
+
+/**
+ * @brief 读者，每个读线程注册一个
+ */
+typedef struct ctrie_reader ctrie_reader_t;
+
+/**
+ * @brief 释放用户数据的函数类型
+ * @param data 用户数据指针
+ */
+typedef void (*ctrie_free_fn_t)(void *data);
+
+/**
+ * @brief 创建并发trie树
+ * @param ufree 释放用户数据的函数，可以为NULL
+ * @return 新创建的trie树
+ */
+ctrie_t *ctrie_new(ctrie_free_fn_t ufree);
+
+/**
+ * @brief 释放trie树及全部待回收的节点，调用时不能有读者在临界区内
+ * @param ct trie树
+ */
+void ctrie_free(ctrie_t *ct);
+
+/**
+ * @brief 注册一个读者
+ * @param ct trie树
+ * @return 读者，只能由一个线程使用
+ */
+ctrie_reader_t *ctrie_reader_new(ctrie_t *ct);
+
+/**
+ * @brief 注销读者
+ * @param reader 读者，不能在临界区内
+ */
+void ctrie_reader_free(ctrie_reader_t *reader);
+
+/**
+ * @brief 进入读临界区，之后读到的节点和用户数据在离开前不会被释放
+ * @param reader 读者
+ */
+void ctrie_read_enter(ctrie_reader_t *reader);
+
+/**
+ * @brief 离开读临界区
+ * @param reader 读者
+ */
+void ctrie_read_leave(ctrie_reader_t *reader);
+
+/**
+ * @brief 精确查找路径，需要在读临界区内调用
+ * @param ct trie树
+ * @param path 待查找的路径
+ * @return 路径对应的用户数据，不存在则返回NULL
+ */
+void *ctrie_search(ctrie_t *ct, const char *path);
+
+/**
+ * @brief 最长前缀匹配，需要在读临界区内调用
+ * @param ct trie树
+ * @param path 待查找的路径
+ * @param matched_len 输出匹配的路径前缀长度
+ * @return 路径上最深的带用户数据节点的数据，没有则返回NULL
+ */
+void *ctrie_longest_prefix(ctrie_t *ct, const char *path, size_t *matched_len);
+
+/**
+ * @brief 插入路径或替换路径上的用户数据，被替换的数据延迟释放
+ * @param ct trie树
+ * @param path 路径
+ * @param data 用户数据
+ * @return 新插入返回0，替换已有数据返回1
+ */
+int ctrie_insert(ctrie_t *ct, const char *path, void *data);
+
+/**
+ * @brief 删除路径及其子树，节点和用户数据延迟释放
+ * @param ct trie树
+ * @param path 路径
+ * @return 成功返回0，路径不存在返回-1
+ */
+int ctrie_remove(ctrie_t *ct, const char *path);
+
+#endif /* CTRIE_H */
@@ -0,0 +1,287 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+
+/**
+ * 第一次压入时分配的容量
+ */
+#define DEQUE_MIN_CAP 8
+
+/**
+ * 双端队列，元素存放在容量为2的幂的环形数组中，两端压入弹出都是O(1)，
+ * 容量不够时按两倍扩展，弹出时不收缩。第 i 个元素在 items[(head + i) & (cap - 1)]。
+ */
+struct deque_st {
+    void **items; /**< 环形数组 */
+    size_t head;  /**< 队首元素的下标 */
+    size_t size;  /**< 元素个数 */
+    size_t cap;   /**< 数组容量，0 或 2 的幂 */
+};
+
+typedef struct deque_st deque_t;
+
+/**
+ * 创建一个新的双端队列
+ *
+ * @return 新的双端队列
+ */
+deque_t *deque_new();
+
+/**
+ * 初始化一个由调用者提供内存的双端队列，初始化时不分配内存
+ *
+ * @param dq 双端队列
+ */
+void deque_init(deque_t *dq);
+
+/**
+ * 释放 deque_init 初始化的双端队列的数组，不释放队列本身
+ *
+ * @param dq 双端队列
+ */
+void deque_destroy(deque_t *dq);
+
+/**
+ * 释放整个双端队列的内存
+ *
+ * @param dq 双端队列
+ */
+void deque_free(deque_t *dq);
+
+/**
+ * 预留容量，之后元素总数不超过 n 时不再分配内存
+ *
+ * @param dq 双端队列
+ * @param n 元素个数
+ */
+void deque_reserve(deque_t *dq, size_t n);
+
+/**
+ * 在队尾压入一个元素
+ *
+ * @param dq 双端队列
+ * @param data 数据指针
+ */
+void deque_push_back(deque_t *dq, void *data);
+
+/**
+ * 在队首压入一个元素
+ *
+ * @param dq 双端队列
+ * @param data 数据指针
+ */
+void deque_push_front(deque_t *dq, void *data);
+
+/**
+ * 弹出队尾元素
+ *
+ * @param dq 双端队列
+ * @return 队尾元素，队列为空时返回NULL
+ */
+void *deque_pop_back(deque_t *dq);
+
+/**
+ * 弹出队首元素
+ *
+ * @param dq 双端队列
+ * @return 队首元素，队列为空时返回NULL
+ */
+void *deque_pop_front(deque_t *dq);
+
+/**
+ * 返回队首元素
+ *
+ * @param dq 双端队列
+ * @return 队首元素，队列为空时返回NULL
+ */
+void *deque_front(deque_t *dq);
+
+/**
+ * 返回队尾元素
+ *
+ * @param dq 双端队列
+ * @return 队尾元素，队列为空时返回NULL
+ */
+void *deque_back(deque_t *dq);
+
+/**
+ * 返回第 i 个元素，0 是队首
+ *
+ * @param dq 双端队列
+ * @param i 下标
+ * @return 第 i 个元素，越界时返回NULL
+ */
+void *deque_at(deque_t *dq, size_t i);
+
+/**
+ * 替换第 i 个元素
+ *
+ * @param dq 双端队列
+ * @param i 下标
+ * @param data 数据指针
+ * @return 成功返回0，越界返回-1
+ */
+int deque_set(deque_t *dq, size_t i, void *data);
+
+/**
+ * 依次在队尾压入 n 个元素，data[n - 1] 成为队尾，最多两次 memcpy
+ *
+ * @param dq 双端队列
+ * @param data 数据指针数组
+ * @param n 元素个数
+ */
+void deque_push_back_n(deque_t *dq, void *const *data, size_t n);
+
+/**
+ * 从队首弹出至多 n 个元素，按队列顺序写入 out
+ *
+ * @param dq 双端队列
+ * @param out 输出数组
+ * @param n 最多弹出的个数
+ * @return 实际弹出的个数
+ */
+size_t deque_pop_front_n(deque_t *dq, void **out, size_t n);
+
+/**
+ * 把从第 i 个元素开始的至多 n 个元素复制到 out，不修改队列
+ *
+ * @param dq 双端队列
+ * @param i 起始下标
+ * @param out 输出数组
+ * @param n 最多复制的个数
+ * @return 实际复制的个数
+ */
+size_t deque_copy_out(deque_t *dq, size_t i, void **out, size_t n);
+
+/**
+ * 返回元素个数
+ *
+ * @param dq 双端队列
+ * @return 元素个数
+ */
+size_t deque_size(deque_t *dq);
+
+/**
+ * 双端队列是否为空
+ *
+ * @param dq 双端队列
+ * @return bool
+ */
+bool deque_empty(deque_t *dq);
+
+/**
+ * 清空双端队列，保留已分配的容量
+ *
+ * @param dq 双端队列
+ */
+void deque_clear(deque_t *dq);
+
+/**
+ * 定义元素类型为 type 的双端队列 name##_t 及其内联操作函数，布局与 deque_t 相同。
+ * 元素按值存放，pop 系列函数通过 out 返回元素，队列为空时返回false：
+ *
+ *     DEQUE_DEFINE(u32q, uint32_t)
+ *
+ *     u32q_t q;
+ *     uint32_t v;
+ *     u32q_init(&q);
+ *     u32q_push_back(&q, 1);
+ *     while (u32q_pop_front(&q, &v)) ...
+ *     u32q_destroy(&q);
+ */
+#define DEQUE_DEFINE(name, type)                                                \
+typedef struct name##_st {                                                      \
+    type *items;                                                                \
+    size_t head;                                                                \
+    size_t size;                                                                \
+    size_t cap;                                                                 \
+} name##_t;                                                                     \
+                                                                                \
+static inline void name##_init(name##_t *dq)                                    \
+{                                                                               \
+    dq->items = NULL;                                                           \
+    dq->head = dq->size = dq->cap = 0;                                          \
+}                                                                               \
+                                                                                \
+static inline void name##_destroy(name##_t *dq)                                 \
+{                                                                               \
+    xfree(dq->items);                                                           \
+    name##_init(dq);                                                            \
+}                                                                               \
+                                                                                \
+static inline void name##_reserve(name##_t *dq, size_t n)                       \
+{                                                                               \
+    size_t cap = dq->cap ? dq->cap : DEQUE_MIN_CAP, old = dq->cap;              \
+                                                                                \
+    if (n <= dq->cap)                                                           \
+        return;                                                                 \
+    while (cap < n)                                                             \
+        cap *= 2;                                                               \
+                                                                                \
+    dq->items = (type *)xrealloc(dq->items, cap * sizeof(type));                \
+    if (dq->head + dq->size > old)                                              \
+        memcpy(dq->items + old, dq->items,                                      \
+               (dq->head + dq->size - old) * sizeof(type));                     \
+    dq->cap = cap;                                                              \
+}                                                                               \
+                                                                                \
+static inline void name##_push_back(name##_t *dq, type v)                       \
+{                                                                               \
+    if (dq->size == dq->cap)                                                    \
+        name##_reserve(dq, dq->size + 1);                                       \
+    dq->items[(dq->head + dq->size++) & (dq->cap - 1)] = v;                     \
+}                                                                               \
+                                                                                \
+static inline void name##_push_front(name##_t *dq, type v)                      \
+{                                                                               \
+    if (dq->size == dq->cap)                                                    \
+        name##_reserve(dq, dq->size + 1);                                       \
+    dq->head = (dq->head - 1) & (dq->cap - 1);                                  \
+    dq->items[dq->head] = v;                                                    \
+    dq->size++;                                                                 \
+}                                                                               \
+                                                                                \
+static inline bool name##_pop_back(name##_t *dq, type *out)                     \
+{                                                                               \
+    if (dq->size == 0)                                                          \
+        return false;                                                           \
+    *out = dq->items[(dq->head + --dq->size) & (dq->cap - 1)];                  \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_pop_front(name##_t *dq, type *out)                    \
+{                                                                               \
+    if (dq->size == 0)                                                          \
+        return false;                                                           \
+    *out = dq->items[dq->head];                                                 \
+    dq->head = (dq->head + 1) & (dq->cap - 1);                                  \
+    dq->size--;                                                                 \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline type *name##_at(name##_t *dq, size_t i)                           \
+{                                                                               \
+    return i < dq->size ? &dq->items[(dq->head + i) & (dq->cap - 1)] : NULL;    \
+}                                                                               \
+                                                                                \
+static inline size_t name##_size(name##_t *dq)                                  \
+{                                                                               \
+    return dq->size;                                                            \
+}                                                                               \
+                                                                                \
+static inline bool name##_empty(name##_t *dq)                                   \
+{                                                                               \
+    return dq->size == 0;                                                       \
+}                                                                               \
+                                                                                \
+static inline void name##_clear(name##_t *dq)                                   \
+{                                                                               \
+    dq->head = dq->size = 0;                                                    \
+}
+
+#endif /* DEQUE_H */
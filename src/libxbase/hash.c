@@ -516,6 +516,14 @@ int hash_table_count(const hash_table_t *ht)
     return ht->count;
 }
 
+/* Return the number of bytes used by the table, counting every slot
+   of the mappings array whether it is occupied or not.  */
+
+size_t hash_table_memory(const hash_table_t *ht)
+{
+    return sizeof(*ht) + (size_t)ht->size * sizeof(struct mapping);
+}
+
 /* Functions from this point onward are meant for convenience and
    don't strictly belong to this file.  However, this is as good a
    place for them as any.  */
@@ -9,6 +9,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * @brief 哈希表结构体
@@ -114,6 +115,13 @@ void hash_table_map(hash_table_t *ht, int (*func)(void *, void *, void *), void
  */
 int hash_table_count(const hash_table_t *ht);
 
+/**
+ * @brief 获取哈希表占用的内存字节数，包括表头和整个槽位数组
+ * @param ht 哈希表指针
+ * @return 字节数
+ */
+size_t hash_table_memory(const hash_table_t *ht);
+
 /**
  * @brief 创建一个字符串哈希表
  * @param size 哈希表大小
@@ -0,0 +1,169 @@
+#include "lfstack.h"
+
+/* x86-64 与 AArch64 的用户态地址不超过48位，高16位用作版本号 */
+#define LFSTACK_PTR_BITS 48
+#define LFSTACK_PTR_MASK ((UINT64_C(1) << LFSTACK_PTR_BITS) - 1)
+
+static inline lfstack_node_t *lfstack_ptr(uint64_t top)
+{
+    return (lfstack_node_t *)(uintptr_t)(top & LFSTACK_PTR_MASK);
+}
+
+static inline uint64_t lfstack_pack(const lfstack_node_t *node, uint64_t old)
+{
+    uint64_t tag = (old >> LFSTACK_PTR_BITS) + 1;
+
+    return (tag << LFSTACK_PTR_BITS) | ((uint64_t)(uintptr_t)node & LFSTACK_PTR_MASK);
+}
+
+void lfstack_init(lfstack_t *s)
+{
+    __atomic_store_n(&s->top, 0, __ATOMIC_RELAXED);
+}
+
+void lfstack_push(lfstack_t *s, lfstack_node_t *node)
+{
+    uint64_t old = __atomic_load_n(&s->top, __ATOMIC_RELAXED);
+
+    do {
+        __atomic_store_n(&node->next, lfstack_ptr(old), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&s->top, &old, lfstack_pack(node, old), true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+lfstack_node_t *lfstack_pop(lfstack_t *s)
+{
+    uint64_t old = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+    lfstack_node_t *node, *next;
+
+    do {
+        node = lfstack_ptr(old);
+        if (node == NULL)
+            return NULL;
+
+        /* node 可能刚被其他线程弹出并改写，读到的 next 会因版本号变化而被丢弃 */
+        next = __atomic_load_n(&node->next, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&s->top, &old, lfstack_pack(next, old), true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    return node;
+}
+
+lfstack_node_t *lfstack_pop_all(lfstack_t *s)
+{
+    uint64_t old = __atomic_load_n(&s->top, __ATOMIC_RELAXED);
+
+    while (lfstack_ptr(old) &&
+           !__atomic_compare_exchange_n(&s->top, &old, lfstack_pack(NULL, old), true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        ;
+
+    return lfstack_ptr(old);
+}
+
+bool lfstack_empty(lfstack_t *s)
+{
+    return lfstack_ptr(__atomic_load_n(&s->top, __ATOMIC_RELAXED)) == NULL;
+}
+
+#ifdef TEST_LFSTACK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "list.h"
+#include "xmalloc.h"
+
+#define NODES_PER_THREAD 64
+#define OPS_PER_THREAD 1000000
+
+struct item {
+    lfstack_node_t node;
+    list_t link;
+};
+
+static lfstack_t stack;
+static list_t locked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 每个线程反复从共享的空闲链表取出一个对象再放回 */
+static void *lockfree_worker(void *arg)
+{
+    for (int i = 0; i < OPS_PER_THREAD; i++) {
+        lfstack_node_t *node = lfstack_pop(&stack);
+        if (node)
+            lfstack_push(&stack, node);
+    }
+    return arg;
+}
+
+static void *locked_worker(void *arg)
+{
+    for (int i = 0; i < OPS_PER_THREAD; i++) {
+        pthread_mutex_lock(&lock);
+        list_t *link = list_pop_head(&locked);
+        pthread_mutex_unlock(&lock);
+
+        if (link) {
+            pthread_mutex_lock(&lock);
+            list_add_head(&locked, link);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    return arg;
+}
+
+static double run(int nthread, void *(*worker)(void *))
+{
+    pthread_t *tids = xnew_array(pthread_t, nthread);
+    double t0 = now();
+
+    for (int i = 0; i < nthread; i++)
+        pthread_create(&tids[i], NULL, worker, NULL);
+    for (int i = 0; i < nthread; i++)
+        pthread_join(tids[i], NULL);
+
+    double t1 = now();
+    xfree(tids);
+
+    return (t1 - t0) * 1e9 / ((double)nthread * OPS_PER_THREAD);
+}
+
+int main(void)
+{
+    struct item *items = xnew0_array(struct item, 64 * NODES_PER_THREAD);
+    size_t count = 0;
+
+    lfstack_init(&stack);
+    list_init(&locked);
+    for (int i = 0; i < 64 * NODES_PER_THREAD; i++) {
+        lfstack_push(&stack, &items[i].node);
+        list_init(&items[i].link);
+        list_add_head(&locked, &items[i].link);
+    }
+
+    for (int n = 1; n <= 64; n *= 2) {
+        double lf = run(n, lockfree_worker);
+        double mx = run(n, locked_worker);
+
+        printf("threads %2d: lock-free %7.1f ns/op  mutex list %7.1f ns/op\n", n, lf, mx);
+    }
+
+    /* 所有节点都应还在栈中，且没有重复 */
+    for (lfstack_node_t *node = lfstack_pop_all(&stack); node; node = node->next)
+        count++;
+    printf("%zu of %d nodes returned\n", count, 64 * NODES_PER_THREAD);
+
+    xfree(items);
+    return count == 64 * NODES_PER_THREAD ? 0 : 1;
+}
+#endif /* TEST_LFSTACK */
@@ -0,0 +1,76 @@
+/**
+ * @file lfstack.h
+ * @brief 无锁的Treiber栈，节点嵌入在用户结构体中，用法同 list_t 与 list_entry
+ *
+ * 栈顶是一个64位字：低48位是节点指针，高16位是每次修改都加一的版本号，
+ * 比较交换时连同版本号一起比较，降低节点被弹出又压回后出现ABA问题的概率。
+ * 版本号只有16位，一个线程在 lfstack_pop 读到栈顶之后、比较交换之前如果被挂起，
+ * 期间其他线程恰好做了65536的整数倍次压入弹出，并且栈顶又是同一个节点，
+ * ABA仍会发生；这个窗口很小，但并没有被排除。
+ * 弹出时会读取可能已被其他线程弹出的节点的 next，所以节点的内存在
+ * 栈仍被使用期间不能归还给系统，适合做对象的空闲链表。
+ */
+
+#ifndef LFSTACK_H
+#define LFSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 嵌入在用户结构体中的栈节点
+ */
+typedef struct lfstack_node {
+    struct lfstack_node *next;
+} lfstack_node_t;
+
+/**
+ * @brief 无锁栈，单独占一个缓存行，避免与相邻数据伪共享
+ */
+typedef struct lfstack {
+    uint64_t top; /**< 节点指针与版本号 */
+    char pad[64 - sizeof(uint64_t)];
+} __attribute__((aligned(64))) lfstack_t;
+
+/**
+ * @brief 由节点指针得到包含它的用户结构体
+ */
+#define lfstack_entry(ptr, type, elem) \
+    ((type *)((char *)(ptr)-offsetof(type, elem)))
+
+/**
+ * @brief 初始化为空栈
+ * @param s 栈
+ */
+void lfstack_init(lfstack_t *s);
+
+/**
+ * @brief 压入节点，可以多个线程同时调用
+ * @param s 栈
+ * @param node 节点，不能已经在栈中
+ */
+void lfstack_push(lfstack_t *s, lfstack_node_t *node);
+
+/**
+ * @brief 弹出栈顶节点，可以多个线程同时调用
+ * @param s 栈
+ * @return 栈顶节点，栈为空时返回NULL
+ */
+lfstack_node_t *lfstack_pop(lfstack_t *s);
+
+/**
+ * @brief 一次取走全部节点
+ * @param s 栈
+ * @return 原来的栈顶节点，其余节点通过 next 相连，栈为空时返回NULL
+ */
+lfstack_node_t *lfstack_pop_all(lfstack_t *s);
+
+/**
+ * @brief 栈是否为空，返回时结果可能已被其他线程改变
+ * @param s 栈
+ * @return 为空返回true
+ */
+bool lfstack_empty(lfstack_t *s);
+
+#endif /* LFSTACK_H */
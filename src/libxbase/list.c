@@ -169,4 +169,166 @@ void list_del(list_t *l, list_t *elem)
     elem->next->prev = elem->prev;
     elem->next = elem;
     elem->prev = elem;
-}
\ No newline at end of file
+}
+
+void list_splice_tail(list_t *l, list_t *other)
+{
+    list_t *first = other->next, *last = other->prev;
+
+    if (first == other) {
+        return;
+    }
+
+    first->prev = l->prev;
+    l->prev->next = first;
+    last->next = l;
+    l->prev = last;
+
+    list_init(other);
+}
+
+void list_splice_head(list_t *l, list_t *other)
+{
+    list_t *first = other->next, *last = other->prev;
+
+    if (first == other) {
+        return;
+    }
+
+    last->next = l->next;
+    l->next->prev = last;
+    first->prev = l;
+    l->next = first;
+
+    list_init(other);
+}
+
+void list_cut(list_t *l, list_t *last, list_t *out)
+{
+    list_t *first = l->next;
+
+    // Unlink [first, last] from 'l'
+    l->next = last->next;
+    last->next->prev = l;
+
+    first->prev = out->prev;
+    out->prev->next = first;
+    last->next = out;
+    out->prev = last;
+}
+
+void clist_init(clist_t *cl)
+{
+    list_init(&cl->list);
+    cl->count = 0;
+}
+
+void clist_clear(clist_t *cl)
+{
+    list_clear(&cl->list);
+    cl->count = 0;
+}
+
+size_t clist_count(clist_t *cl)
+{
+    return cl->count;
+}
+
+bool clist_is_empty(clist_t *cl)
+{
+    return cl->count == 0;
+}
+
+list_t *clist_head(clist_t *cl)
+{
+    return list_head(&cl->list);
+}
+
+list_t *clist_tail(clist_t *cl)
+{
+    return list_tail(&cl->list);
+}
+
+// An element that is still linked can only be on this list and is just moved
+static void clist_link(clist_t *cl, list_t *elem)
+{
+    if (elem->next == elem) {
+        cl->count++;
+    }
+}
+
+void clist_add_head(clist_t *cl, list_t *elem)
+{
+    clist_link(cl, elem);
+    list_add_head(&cl->list, elem);
+}
+
+void clist_add_tail(clist_t *cl, list_t *elem)
+{
+    clist_link(cl, elem);
+    list_add_tail(&cl->list, elem);
+}
+
+void clist_add_after(clist_t *cl, list_t *prev, list_t *elem)
+{
+    clist_link(cl, elem);
+    list_add_after(&cl->list, prev, elem);
+}
+
+void clist_add_before(clist_t *cl, list_t *next, list_t *elem)
+{
+    clist_link(cl, elem);
+    list_add_before(&cl->list, next, elem);
+}
+
+list_t *clist_pop_head(clist_t *cl)
+{
+    list_t *head = list_pop_head(&cl->list);
+
+    if (head != NULL) {
+        cl->count--;
+    }
+
+    return head;
+}
+
+list_t *clist_pop_tail(clist_t *cl)
+{
+    list_t *tail = list_pop_tail(&cl->list);
+
+    if (tail != NULL) {
+        cl->count--;
+    }
+
+    return tail;
+}
+
+void clist_del(clist_t *cl, list_t *elem)
+{
+    if (elem->next != elem) {
+        cl->count--;
+    }
+
+    list_del(&cl->list, elem);
+}
+
+void clist_splice_tail(clist_t *cl, clist_t *other)
+{
+    list_splice_tail(&cl->list, &other->list);
+    cl->count += other->count;
+    other->count = 0;
+}
+
+void clist_splice_head(clist_t *cl, clist_t *other)
+{
+    list_splice_head(&cl->list, &other->list);
+    cl->count += other->count;
+    other->count = 0;
+}
+
+void clist_cut(clist_t *cl, list_t *last, size_t n, clist_t *out)
+{
+    list_cut(&cl->list, last, &out->list);
+    cl->count -= n;
+    out->count += n;
+}
@@ -66,7 +66,8 @@ bool list_is_empty(list_t *l);
 
 /**
  * @param l list
- * @return     element count in the list, beware this is a log(n) operation.
+ * @return     element count in the list, beware this is an O(n) operation,
+ *             use clist_t if the count is needed often.
  */
 size_t list_count(list_t *l);
 
@@ -149,6 +150,154 @@ void list_add_before(list_t *l, list_t *next,
  */
 void list_del(list_t *l, list_t *elem);
 
+/**
+ *  before : l: item1 -> item2       other: item3 -> item4
+ *  after  : l: item1 -> item2 -> item3 -> item4     other: empty
+ *
+ * @param l     list
+ * @param other list whose elements are moved to the tail of 'l', O(1)
+ */
+void list_splice_tail(list_t *l, list_t *other);
+
+/**
+ *  before : l: item1 -> item2       other: item3 -> item4
+ *  after  : l: item3 -> item4 -> item1 -> item2     other: empty
+ *
+ * @param l     list
+ * @param other list whose elements are moved to the head of 'l', O(1)
+ */
+void list_splice_head(list_t *l, list_t *other);
+
+/**
+ *  before : l: item1 -> 'last' -> item3     out: item4
+ *  after  : l: item3     out: item4 -> item1 -> 'last'
+ *
+ * @param l    list
+ * @param last element of 'l', it and everything before it are moved, O(1)
+ * @param out  list the moved elements are appended to
+ */
+void list_cut(list_t *l, list_t *last, list_t *out);
+
+/**
+ * List head that keeps its element count up to date, so clist_count() is
+ * O(1).  Elements are plain list_t nodes and the list_foreach macros work on
+ * &cl->list, but elements must only be added and removed with the clist_*
+ * functions.  An element added to a clist must be unlinked (initialized or
+ * deleted) or already on that same clist, in which case it is just moved.
+ */
+struct sc_clist {
+    list_t list;
+    size_t count;
+};
+
+typedef struct sc_clist clist_t;
+
+/**
+ * Call once to initialize.
+ * @param cl counted list
+ */
+void clist_init(clist_t *cl);
+
+/**
+ * Unlink all elements.
+ * @param cl counted list
+ */
+void clist_clear(clist_t *cl);
+
+/**
+ * @param cl counted list
+ * @return   element count, O(1)
+ */
+size_t clist_count(clist_t *cl);
+
+/**
+ * @param cl counted list
+ * @return   'true' if empty
+ */
+bool clist_is_empty(clist_t *cl);
+
+/**
+ * @param cl counted list
+ * @return   returns head. If list is empty, returns NULL.
+ */
+list_t *clist_head(clist_t *cl);
+
+/**
+ * @param cl counted list
+ * @return   returns tail. If list is empty, returns NULL.
+ */
+list_t *clist_tail(clist_t *cl);
+
+/**
+ * @param cl   counted list
+ * @param elem elem to add to the head
+ */
+void clist_add_head(clist_t *cl, list_t *elem);
+
+/**
+ * @param cl   counted list
+ * @param elem elem to append to the tail
+ */
+void clist_add_tail(clist_t *cl, list_t *elem);
+
+/**
+ * @param cl   counted list
+ * @param prev element of 'cl' to add 'elem' after
+ * @param elem elem to be added
+ */
+void clist_add_after(clist_t *cl, list_t *prev, list_t *elem);
+
+/**
+ * @param cl   counted list
+ * @param next element of 'cl' to add 'elem' before
+ * @param elem elem to be added
+ */
+void clist_add_before(clist_t *cl, list_t *next, list_t *elem);
+
+/**
+ * @param cl counted list
+ * @return   head element, if list is empty, returns NULL.
+ */
+list_t *clist_pop_head(clist_t *cl);
+
+/**
+ * @param cl counted list
+ * @return   tail element, if list is empty, returns NULL.
+ */
+list_t *clist_pop_tail(clist_t *cl);
+
+/**
+ * @param cl   counted list
+ * @param elem element of 'cl' to be deleted
+ */
+void clist_del(clist_t *cl, list_t *elem);
+
+/**
+ * Move all elements of 'other' to the tail of 'cl', O(1).
+ * @param cl    counted list
+ * @param other counted list, empty afterwards
+ */
+void clist_splice_tail(clist_t *cl, clist_t *other);
+
+/**
+ * Move all elements of 'other' to the head of 'cl', O(1).
+ * @param cl    counted list
+ * @param other counted list, empty afterwards
+ */
+void clist_splice_head(clist_t *cl, clist_t *other);
+
+/**
+ * Move the elements from the head of 'cl' up to and including 'last' to the
+ * tail of 'out'.  The caller passes how many elements that is, which keeps
+ * the operation O(1); it is usually known from the walk that found 'last'.
+ *
+ * @param cl   counted list
+ * @param last element of 'cl'
+ * @param n    number of elements from the head to 'last', inclusive
+ * @param out  counted list the elements are appended to
+ */
+void clist_cut(clist_t *cl, list_t *last, size_t n, clist_t *out);
+
 /**
  * struct container {
  *      struct sc_list others;
@@ -0,0 +1,258 @@
+#include "mpmcq.h"
+#include "xmalloc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MPMCQ_CACHELINE 64
+
+/* seq 等于位置时槽位可写，等于位置加一时槽位可读 */
+struct mpmcq_cell {
+    size_t seq;
+    void *data;
+};
+
+/* 入队与出队位置各占一个缓存行，生产者和消费者不会互相使对方的缓存失效 */
+struct mpmcq {
+    struct mpmcq_cell *cells;
+    size_t mask;
+    char pad0[MPMCQ_CACHELINE - sizeof(void *) - sizeof(size_t)];
+
+    size_t head; /* 下一个出队位置 */
+    char pad1[MPMCQ_CACHELINE - sizeof(size_t)];
+
+    size_t tail; /* 下一个入队位置 */
+    char pad2[MPMCQ_CACHELINE - sizeof(size_t)];
+};
+
+mpmcq_t *mpmcq_new(size_t cap)
+{
+    mpmcq_t *q;
+    size_t n = 2;
+
+    while (n < cap)
+        n *= 2;
+
+    q = xnew0(mpmcq_t);
+    q->cells = xnew_array(struct mpmcq_cell, n);
+    q->mask = n - 1;
+    for (size_t i = 0; i < n; i++)
+        __atomic_store_n(&q->cells[i].seq, i, __ATOMIC_RELAXED);
+
+    return q;
+}
+
+void mpmcq_free(mpmcq_t *q)
+{
+    if (!q)
+        return;
+
+    xfree(q->cells);
+    xfree(q);
+}
+
+int mpmcq_push(mpmcq_t *q, void *data)
+{
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    struct mpmcq_cell *cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int mpmcq_pop(mpmcq_t *q, void **data)
+{
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    struct mpmcq_cell *cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    *data = cell->data;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+size_t mpmcq_size(mpmcq_t *q)
+{
+    size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    return tail > head ? tail - head : 0;
+}
+
+size_t mpmcq_capacity(mpmcq_t *q)
+{
+    return q->mask + 1;
+}
+
+#ifdef TEST_MPMCQ
+
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "list.h"
+
+#define ITEMS 2000000
+
+struct item {
+    list_t link;
+    size_t value;
+};
+
+static mpmcq_t *queue;
+static list_t locked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct item *items;
+static size_t nproducer, nconsumer;
+static size_t produced, consumed, checksum;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 生产者领取编号后入队，消费者出队并累加编号，结束时校验总和 */
+static void *producer(void *arg)
+{
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&produced, 1, __ATOMIC_RELAXED)) < ITEMS) {
+        while (mpmcq_push(queue, &items[i]) != 0)
+            sched_yield();
+    }
+    return arg;
+}
+
+static void *consumer(void *arg)
+{
+    size_t sum = 0;
+    void *data;
+
+    while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < ITEMS) {
+        if (mpmcq_pop(queue, &data) == 0) {
+            sum += ((struct item *)data)->value;
+            __atomic_fetch_add(&consumed, 1, __ATOMIC_RELAXED);
+        } else {
+            sched_yield();
+        }
+    }
+    __atomic_fetch_add(&checksum, sum, __ATOMIC_RELAXED);
+    return arg;
+}
+
+static void *locked_producer(void *arg)
+{
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&produced, 1, __ATOMIC_RELAXED)) < ITEMS) {
+        pthread_mutex_lock(&lock);
+        list_add_tail(&locked, &items[i].link);
+        pthread_mutex_unlock(&lock);
+    }
+    return arg;
+}
+
+static void *locked_consumer(void *arg)
+{
+    size_t sum = 0;
+    list_t *link;
+
+    while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < ITEMS) {
+        pthread_mutex_lock(&lock);
+        link = list_pop_head(&locked);
+        pthread_mutex_unlock(&lock);
+
+        if (link) {
+            sum += list_entry(link, struct item, link)->value;
+            __atomic_fetch_add(&consumed, 1, __ATOMIC_RELAXED);
+        } else {
+            sched_yield();
+        }
+    }
+    __atomic_fetch_add(&checksum, sum, __ATOMIC_RELAXED);
+    return arg;
+}
+
+static double run(void *(*prod)(void *), void *(*cons)(void *))
+{
+    size_t n = nproducer + nconsumer;
+    pthread_t *tids = xnew_array(pthread_t, n);
+    double t0 = now();
+
+    produced = consumed = checksum = 0;
+    for (size_t i = 0; i < n; i++)
+        pthread_create(&tids[i], NULL, i < nproducer ? prod : cons, NULL);
+    for (size_t i = 0; i < n; i++)
+        pthread_join(tids[i], NULL);
+
+    double t1 = now();
+    xfree(tids);
+
+    if (checksum != (size_t)ITEMS * (ITEMS - 1) / 2)
+        printf("checksum mismatch\n");
+    return (t1 - t0) * 1e9 / ITEMS;
+}
+
+int main(void)
+{
+    items = xnew_array(struct item, ITEMS);
+    for (size_t i = 0; i < ITEMS; i++) {
+        list_init(&items[i].link);
+        items[i].value = i;
+    }
+
+    queue = mpmcq_new(1024);
+    list_init(&locked);
+
+    /* 线程总数为 1 时生产者与消费者是同一个线程交替执行，这里至少各一个 */
+    for (size_t n = 2; n <= 64; n *= 2) {
+        nproducer = n / 2;
+        nconsumer = n - nproducer;
+
+        double lf = run(producer, consumer);
+        double mx = run(locked_producer, locked_consumer);
+
+        printf("threads %2zu (%zu+%zu): mpmcq %7.1f ns/item  mutex list %7.1f ns/item\n",
+               n, nproducer, nconsumer, lf, mx);
+    }
+
+    mpmcq_free(queue);
+    xfree(items);
+    return 0;
+}
+#endif /* TEST_MPMCQ */
@@ -0,0 +1,63 @@
+/**
+ * @file mpmcq.h
+ * @brief 有界的多生产者多消费者无锁队列(Vyukov算法)
+ *
+ * 队列是容量为2的幂的环形数组，每个槽位带一个序号：生产者和消费者各自用
+ * 一次比较交换抢占位置，再通过槽位序号交接数据，不分配内存。
+ * 队列满时 push 失败、队列空时 pop 失败，由调用者决定重试或退避。
+ */
+
+#ifndef MPMCQ_H
+#define MPMCQ_H
+
+#include <stddef.h>
+
+/**
+ * @brief 多生产者多消费者队列
+ */
+typedef struct mpmcq mpmcq_t;
+
+/**
+ * @brief 创建队列
+ * @param cap 容量，向上取整为2的幂，至少为2
+ * @return 新创建的队列
+ */
+mpmcq_t *mpmcq_new(size_t cap);
+
+/**
+ * @brief 释放队列，队列中剩余的数据不做处理
+ * @param q 队列
+ */
+void mpmcq_free(mpmcq_t *q);
+
+/**
+ * @brief 入队，可以多个线程同时调用
+ * @param q 队列
+ * @param data 数据指针
+ * @return 成功返回0，队列满返回-1
+ */
+int mpmcq_push(mpmcq_t *q, void *data);
+
+/**
+ * @brief 出队，可以多个线程同时调用
+ * @param q 队列
+ * @param data 输出数据指针
+ * @return 成功返回0，队列空返回-1
+ */
+int mpmcq_pop(mpmcq_t *q, void **data);
+
+/**
+ * @brief 队列中元素的个数，并发修改时只是近似值
+ * @param q 队列
+ * @return 元素个数
+ */
+size_t mpmcq_size(mpmcq_t *q);
+
+/**
+ * @brief 队列容量
+ * @param q 队列
+ * @return 容量
+ */
+size_t mpmcq_capacity(mpmcq_t *q);
+
+#endif /* MPMCQ_H */
@@ -0,0 +1,201 @@
+#include "mpscq.h"
+
+void mpscq_init(mpscq_t *q)
+{
+    q->stub.next = NULL;
+    q->tail = &q->stub;
+    __atomic_store_n(&q->head, &q->stub, __ATOMIC_RELEASE);
+}
+
+void mpscq_push(mpscq_t *q, mpscq_node_t *node)
+{
+    mpscq_node_t *prev;
+
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&q->head, node, __ATOMIC_ACQ_REL);
+    /* 交换之后到这里之间，node 对消费者不可见 */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+mpscq_node_t *mpscq_pop(mpscq_t *q)
+{
+    mpscq_node_t *tail = q->tail;
+    mpscq_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (next == NULL)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    /* tail 是最后一个可见节点：若还有生产者正在入队，稍后再取 */
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    /* 把占位节点放回队尾，tail 才能出队 */
+    mpscq_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+size_t mpscq_pop_batch(mpscq_t *q, mpscq_node_t **out, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max && (out[n] = mpscq_pop(q)) != NULL)
+        n++;
+
+    return n;
+}
+
+bool mpscq_empty(mpscq_t *q)
+{
+    return q->tail == &q->stub && __atomic_load_n(&q->stub.next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+#ifdef TEST_MPSCQ
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "list.h"
+#include "xmalloc.h"
+
+#define ITEMS 2000000
+#define BATCH 64
+
+struct event {
+    mpscq_node_t node;
+    list_t link;
+    size_t value;
+};
+
+static mpscq_t queue;
+static list_t locked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct event *events;
+static size_t produced;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *producer(void *arg)
+{
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&produced, 1, __ATOMIC_RELAXED)) < ITEMS)
+        mpscq_push(&queue, &events[i].node);
+    return arg;
+}
+
+static void *locked_producer(void *arg)
+{
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&produced, 1, __ATOMIC_RELAXED)) < ITEMS) {
+        pthread_mutex_lock(&lock);
+        list_add_tail(&locked, &events[i].link);
+        pthread_mutex_unlock(&lock);
+    }
+    return arg;
+}
+
+/* 消费者每次取出至多 BATCH 个事件 */
+static size_t consume(void)
+{
+    mpscq_node_t *batch[BATCH];
+    size_t sum = 0, n = 0;
+
+    while (n < ITEMS) {
+        size_t got = mpscq_pop_batch(&queue, batch, BATCH);
+
+        for (size_t i = 0; i < got; i++)
+            sum += mpscq_entry(batch[i], struct event, node)->value;
+        n += got;
+        if (got == 0)
+            sched_yield();
+    }
+    return sum;
+}
+
+static size_t locked_consume(void)
+{
+    size_t sum = 0, n = 0;
+
+    while (n < ITEMS) {
+        size_t got = 0;
+
+        pthread_mutex_lock(&lock);
+        for (list_t *link; got < BATCH && (link = list_pop_head(&locked)) != NULL; got++)
+            sum += list_entry(link, struct event, link)->value;
+        pthread_mutex_unlock(&lock);
+
+        n += got;
+        if (got == 0)
+            sched_yield();
+    }
+    return sum;
+}
+
+static double run(int nproducer, void *(*prod)(void *), size_t (*cons)(void))
+{
+    pthread_t *tids = xnew_array(pthread_t, nproducer);
+    size_t sum;
+    double t0 = now();
+
+    produced = 0;
+    for (int i = 0; i < nproducer; i++)
+        pthread_create(&tids[i], NULL, prod, NULL);
+    sum = cons();
+    for (int i = 0; i < nproducer; i++)
+        pthread_join(tids[i], NULL);
+
+    double t1 = now();
+    xfree(tids);
+
+    if (sum != (size_t)ITEMS * (ITEMS - 1) / 2)
+        printf("checksum mismatch\n");
+    return (t1 - t0) * 1e9 / ITEMS;
+}
+
+int main(void)
+{
+    events = xnew_array(struct event, ITEMS);
+    for (size_t i = 0; i < ITEMS; i++) {
+        list_init(&events[i].link);
+        events[i].value = i;
+    }
+
+    mpscq_init(&queue);
+    list_init(&locked);
+
+    for (int n = 1; n <= 64; n *= 2) {
+        double lf = run(n, producer, consume);
+        double mx = run(n, locked_producer, locked_consume);
+
+        printf("producers %2d: mpscq %6.1f ns/event  mutex list %6.1f ns/event\n", n, lf, mx);
+    }
+
+    xfree(events);
+    return 0;
+}
+#endif /* TEST_MPSCQ */
@@ -0,0 +1,76 @@
+/**
+ * @file mpscq.h
+ * @brief 侵入式的多生产者单消费者队列(Vyukov算法)
+ *
+ * 链接节点嵌入在用户结构体中，用法同 list_t 与 list_entry，入队出队都不分配内存。
+ * 生产者入队只需一次原子交换，不会等待其他线程；出队只能由一个消费者线程调用。
+ * 生产者在交换之后、链接之前被挂起时，消费者会暂时看不到它之后入队的节点，
+ * 此时出队返回NULL，稍后再取即可。
+ */
+
+#ifndef MPSCQ_H
+#define MPSCQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief 嵌入在用户结构体中的队列节点
+ */
+typedef struct mpscq_node {
+    struct mpscq_node *next;
+} mpscq_node_t;
+
+/**
+ * @brief 队列，生产者修改的 head 与消费者使用的 tail 在不同的缓存行
+ */
+typedef struct mpscq {
+    mpscq_node_t *head; /**< 最后入队的节点 */
+    char pad[64 - sizeof(mpscq_node_t *)];
+    mpscq_node_t *tail; /**< 下一个出队的节点 */
+    mpscq_node_t stub;  /**< 队列为空时占位的节点 */
+} __attribute__((aligned(64))) mpscq_t;
+
+/**
+ * @brief 由节点指针得到包含它的用户结构体
+ */
+#define mpscq_entry(ptr, type, elem) \
+    ((type *)((char *)(ptr)-offsetof(type, elem)))
+
+/**
+ * @brief 初始化为空队列
+ * @param q 队列
+ */
+void mpscq_init(mpscq_t *q);
+
+/**
+ * @brief 入队，可以多个线程同时调用
+ * @param q 队列
+ * @param node 节点，出队之前不能再次入队
+ */
+void mpscq_push(mpscq_t *q, mpscq_node_t *node);
+
+/**
+ * @brief 出队，只能由消费者线程调用
+ * @param q 队列
+ * @return 最早入队的节点，队列为空或生产者尚未完成链接时返回NULL
+ */
+mpscq_node_t *mpscq_pop(mpscq_t *q);
+
+/**
+ * @brief 批量出队，只能由消费者线程调用
+ * @param q 队列
+ * @param out 按入队顺序输出节点
+ * @param max 最多出队的个数
+ * @return 实际出队的个数
+ */
+size_t mpscq_pop_batch(mpscq_t *q, mpscq_node_t **out, size_t max);
+
+/**
+ * @brief 队列是否为空，只能由消费者线程调用
+ * @param q 队列
+ * @return 为空返回true
+ */
+bool mpscq_empty(mpscq_t *q);
+
+#endif /* MPSCQ_H */
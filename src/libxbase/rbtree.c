@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include "xmalloc.h"
@@ -50,15 +51,48 @@ typedef struct rbtree_node_st {
     struct rbtree_node_st *left, *right;
     struct rbtree_node_st *parent;
     rb_color_t color;
+    uint32_t size; /* nodes in this subtree, kept with RFLAG_ORDER_STAT */
+    char kbuf[]; /* copied keys up to RB_INLINE_KEY_MAX bytes live here */
 } rbtree_node_st;
 
+/*
+ * Copied keys of up to RB_INLINE_KEY_MAX bytes are stored at the end of
+ * the node, so a lookup touches one allocation per level.  Nodes come in
+ * size classes of 16 key bytes; class 0 has no inline key and is used for
+ * external keys and for keys too long to inline, which are allocated
+ * separately as before.
+ */
+#define RB_INLINE_KEY_MAX 64
+#define RB_KEY_CLASS(ksize) (((ksize) + 15) >> 4)
+#define RB_POOL_NCLASS (RB_KEY_CLASS(RB_INLINE_KEY_MAX) + 1)
+#define RB_POOL_SLAB (64 * 1024)
+
+#define node_class_size(c) \
+    ((offsetof(rbtree_node_st, kbuf) + (size_t)(c) * 16 + 7) & ~(size_t)7)
+
+typedef struct rbtree_slab_st {
+    struct rbtree_slab_st *next;
+    char mem[];
+} rbtree_slab_st;
+
+/* free nodes are chained through their 'left' pointer */
+typedef struct rbtree_pool_st {
+    rbtree_node_st *free[RB_POOL_NCLASS];
+    char *cur, *end;
+    rbtree_slab_st *slabs;
+    size_t nbytes; /* slab memory */
+} rbtree_pool_st;
+
 struct rbtree_st {
     rbtree_node_st *root;
     rbtree_node_st *first, *last;
     uint32_t nelem;
+    uint32_t nkey_alloc; /* copied keys that are not inline */
+    size_t nbytes;       /* memory of nodes not taken from the pool */
     int flag;
     rbtree_cmp_func_t cmp_fn;
     rbtree_data_free_func_t data_free;
+    rbtree_pool_st pool;
 };
 
 #define get_color(node) ((node)->color)
@@ -68,6 +102,8 @@ struct rbtree_st {
 #define is_root(node) (get_parent(node) == NULL)
 #define is_black(node) (get_color(node) == RB_BLACK)
 #define is_red(node) (get_color(node) != RB_BLACK)
+#define get_size(node) ((node) ? (node)->size : 0)
+#define order_stat(tree) ((tree)->flag & RFLAG_ORDER_STAT)
 
 #ifdef _MSC_VER
 #define inline __inline
@@ -186,6 +222,11 @@ static void rotate_left(rbtree_st *tree, rbtree_node_st *node)
     if (p->right)
         set_parent(p, p->right);
     q->left = p;
+
+    if (order_stat(tree)) {
+        q->size = p->size;
+        p->size = get_size(p->left) + get_size(p->right) + 1;
+    }
 }
 
 static void rotate_right(rbtree_st *tree, rbtree_node_st *node)
@@ -208,6 +249,91 @@ static void rotate_right(rbtree_st *tree, rbtree_node_st *node)
     if (p->left)
         set_parent(p, p->left);
     q->right = p;
+
+    if (order_stat(tree)) {
+        q->size = p->size;
+        p->size = get_size(p->left) + get_size(p->right) + 1;
+    }
+}
+
+static inline int node_class(const rbtree_st *tree, uint32_t ksize)
+{
+    if ((tree->flag & RFLAG_EXTERN_KEY) || ksize > RB_INLINE_KEY_MAX)
+        return 0;
+    return RB_KEY_CLASS(ksize);
+}
+
+static void *pool_alloc(rbtree_pool_st *pool, int c)
+{
+    size_t size = node_class_size(c);
+    rbtree_node_st *node = pool->free[c];
+    rbtree_slab_st *slab;
+
+    if (node) {
+        pool->free[c] = node->left;
+        return node;
+    }
+
+    if (pool->cur + size > pool->end) {
+        slab = xmalloc(RB_POOL_SLAB);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->nbytes += RB_POOL_SLAB;
+        pool->cur = slab->mem;
+        pool->end = (char *)slab + RB_POOL_SLAB;
+    }
+
+    node = (rbtree_node_st *)pool->cur;
+    pool->cur += size;
+    return node;
+}
+
+static rbtree_node_st *node_alloc(rbtree_st *tree, const void *key, uint32_t ksize)
+{
+    int c = node_class(tree, ksize);
+    rbtree_node_st *node;
+
+    if (tree->flag & RFLAG_NODE_POOL) {
+        node = pool_alloc(&tree->pool, c);
+    } else {
+        node = xmalloc(node_class_size(c));
+        tree->nbytes += node_class_size(c);
+    }
+
+    /* copy key */
+    if (tree->flag & RFLAG_EXTERN_KEY) {
+        node->cs.key = (void *)key;
+    } else {
+        if (c) {
+            node->cs.key = node->kbuf;
+        } else {
+            node->cs.key = xmalloc(ksize);
+            tree->nkey_alloc++;
+        }
+
+        memcpy(node->cs.key, key, ksize);
+    }
+
+    node->cs.ksize = ksize;
+    return node;
+}
+
+static void node_free(rbtree_st *tree, rbtree_node_st *node)
+{
+    int c = node_class(tree, node->cs.ksize);
+
+    if (!(tree->flag & RFLAG_EXTERN_KEY) && c == 0) {
+        free(node->cs.key);
+        tree->nkey_alloc--;
+    }
+
+    if (tree->flag & RFLAG_NODE_POOL) {
+        node->left = tree->pool.free[c];
+        tree->pool.free[c] = node;
+    } else {
+        free(node);
+        tree->nbytes -= node_class_size(c);
+    }
 }
 
 int rbtree_search(const rbtree_st *tree, const void *key, uint32_t ksize, void **val)
@@ -231,78 +357,174 @@ const rb_cursor_st *rbtree_get_cursor(const rbtree_st *tree, const void *key, ui
     return (const rb_cursor_st *)do_lookup(tree, key, ksize, &parent, &is_left);
 }
 
-const rb_cursor_st *rbtree_lower_bound(const rbtree_st *tree, const void *key, uint32_t ksize)
+/*
+ * Single descent for the bounds: every node that satisfies the bound is
+ * a candidate, and the walk continues on the side where a tighter one
+ * could be.  'strict' excludes a node equal to the key.
+ */
+static rbtree_node_st *rb_ceil(const rbtree_st *tree, const void *key, uint32_t ksize, int strict)
 {
-    rbtree_node_st *parent;
-    int is_left;
-    rbtree_node_st *ret = do_lookup(tree, key, ksize, &parent, &is_left);
-    if (ret)
-        return (const rb_cursor_st *)ret;
+    rbtree_node_st *node = tree->root, *best = NULL;
+
+    while (node) {
+        int res = tree->cmp_fn(node->cs.key, node->cs.ksize, key, ksize);
+
+        if (res > 0 || (res == 0 && !strict)) {
+            best = node;
+            if (res == 0)
+                break;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+static rbtree_node_st *rb_floor(const rbtree_st *tree, const void *key, uint32_t ksize, int strict)
+{
+    rbtree_node_st *node = tree->root, *best = NULL;
+
+    while (node) {
+        int res = tree->cmp_fn(node->cs.key, node->cs.ksize, key, ksize);
 
-    while (parent && tree->cmp_fn(parent->cs.key, parent->cs.ksize, key, ksize) < 0) {
-        parent = rb_next(parent);
+        if (res < 0 || (res == 0 && !strict)) {
+            best = node;
+            if (res == 0)
+                break;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
     }
+    return best;
+}
 
-    return (const rb_cursor_st *)parent;
+const rb_cursor_st *rbtree_lower_bound(const rbtree_st *tree, const void *key, uint32_t ksize)
+{
+    return (const rb_cursor_st *)rb_ceil(tree, key, ksize, 0);
 }
 
 const rb_cursor_st *rbtree_upper_bound(const rbtree_st *tree, const void *key, uint32_t ksize)
 {
-    rbtree_node_st *parent;
-    int is_left;
-    rbtree_node_st *ret = do_lookup(tree, key, ksize, &parent, &is_left);
-    if (ret)
-        return (const rb_cursor_st *)ret;
+    return (const rb_cursor_st *)rb_floor(tree, key, ksize, 0);
+}
 
-    while (parent && tree->cmp_fn(parent->cs.key, parent->cs.ksize, key, ksize) > 0) {
-        parent = rb_prev(parent);
+int rbtree_range(rbtree_st *tree, const void *lo, uint32_t lo_size,
+                 const void *hi, uint32_t hi_size, int flag,
+                 void *userdata, rbtree_foreach_func_t fn)
+{
+    rbtree_node_st *node, *end = NULL;
+    int res;
+
+    if (!(void *)fn)
+        return 0;
+
+    node = lo ? rb_ceil(tree, lo, lo_size, flag & RB_RANGE_EXCL_LO) : tree->first;
+    if (!node)
+        return 0;
+
+    /* 'end' is the first node past the range, found once instead of comparing every step */
+    if (hi) {
+        res = tree->cmp_fn(node->cs.key, node->cs.ksize, hi, hi_size);
+        if (res > 0 || (res == 0 && (flag & RB_RANGE_EXCL_HI)))
+            return 0;
+        end = rb_ceil(tree, hi, hi_size, !(flag & RB_RANGE_EXCL_HI));
+    }
+
+    for (; node != end; node = rb_next(node)) {
+        if ((res = fn(node->cs.key, node->cs.ksize, node->cs.data, userdata)))
+            return res;
     }
 
-    return (const rb_cursor_st *)parent;
+    return 0;
 }
 
-static void set_child(rbtree_node_st *child, rbtree_node_st *node, int left)
+const rb_cursor_st *rbtree_select(const rbtree_st *tree, uint32_t k)
 {
-    if (left)
-        node->left = child;
-    else
-        node->right = child;
+    rbtree_node_st *node = tree->root;
+
+    if (!order_stat(tree) || k >= tree->nelem)
+        return NULL;
+
+    while (node) {
+        uint32_t nleft = get_size(node->left);
+
+        if (k == nleft)
+            break;
+
+        if (k < nleft) {
+            node = node->left;
+        } else {
+            k -= nleft + 1;
+            node = node->right;
+        }
+    }
+    return (const rb_cursor_st *)node;
 }
 
-void rbtree_insert(rbtree_st *tree, const void *key, uint32_t ksize, void *val)
+int rbtree_rank(const rbtree_st *tree, const void *key, uint32_t ksize, uint32_t *rank)
 {
-    rbtree_node_st *parent;
-    int is_left;
-    rbtree_node_st *node = do_lookup(tree, key, ksize, &parent, &is_left);
+    rbtree_node_st *node = tree->root;
+    uint32_t r = 0;
 
-    if (node) {
-        if ((void *)tree->data_free)
-            tree->data_free(node->cs.data);
+    if (!order_stat(tree))
+        return -1;
 
-        if (tree->flag & RFLAG_EXTERN_KEY) {
-            node->cs.key = (void *)key;
-            node->cs.ksize = ksize;
+    while (node) {
+        int res = tree->cmp_fn(node->cs.key, node->cs.ksize, key, ksize);
+
+        if (res < 0) {
+            r += get_size(node->left) + 1;
+            node = node->right;
+        } else if (res > 0) {
+            node = node->left;
+        } else {
+            r += get_size(node->left);
+            break;
         }
-        node->cs.data = val;
-        return;
     }
 
-    node = xmalloc0(sizeof(rbtree_node_st));
+    *rank = r;
+    return 0;
+}
+
+static void set_child(rbtree_node_st *child, rbtree_node_st *node, int left)
+{
+    if (left)
+        node->left = child;
+    else
+        node->right = child;
+}
+
+static void rb_replace(rbtree_st *tree, rbtree_node_st *node,
+                       const void *key, uint32_t ksize, void *val)
+{
+    if ((void *)tree->data_free)
+        tree->data_free(node->cs.data);
 
-    /* copy key */
     if (tree->flag & RFLAG_EXTERN_KEY) {
         node->cs.key = (void *)key;
-    } else {
-        node->cs.key = xmalloc(ksize);
-
-        memcpy(node->cs.key, key, ksize);
+        node->cs.ksize = ksize;
     }
+    node->cs.data = val;
+}
 
-    node->cs.ksize = ksize;
+/*
+ * Attach a new node as the 'is_left' child of 'parent', which must be
+ * free, and rebalance.
+ */
+static rbtree_node_st *rb_link(rbtree_st *tree, rbtree_node_st *parent, int is_left,
+                               const void *key, uint32_t ksize, void *val)
+{
+    rbtree_node_st *node, *ret;
+
+    ret = node = node_alloc(tree, key, ksize);
     node->cs.data = val;
 
     node->left = NULL;
     node->right = NULL;
+    node->size = 1;
     set_color(RB_RED, node);
     set_parent(parent, node);
 
@@ -315,6 +537,13 @@ void rbtree_insert(rbtree_st *tree, const void *key, uint32_t ksize, void *val)
                 tree->last = node;
         }
         set_child(node, parent, is_left);
+
+        if (order_stat(tree)) {
+            rbtree_node_st *p;
+
+            for (p = parent; p; p = get_parent(p))
+                p->size++;
+        }
     } else {
         tree->root = node;
         tree->first = node;
@@ -369,6 +598,87 @@ void rbtree_insert(rbtree_st *tree, const void *key, uint32_t ksize, void *val)
     }
     set_color(RB_BLACK, tree->root);
     tree->nelem++;
+    return ret;
+}
+
+void rbtree_insert(rbtree_st *tree, const void *key, uint32_t ksize, void *val)
+{
+    rbtree_node_st *parent;
+    int is_left, res;
+    rbtree_node_st *node;
+
+    /* appending in key order skips the descent: the new node is last's right child */
+    if (tree->last) {
+        res = tree->cmp_fn(tree->last->cs.key, tree->last->cs.ksize, key, ksize);
+        if (res < 0) {
+            rb_link(tree, tree->last, 0, key, ksize, val);
+            return;
+        }
+        if (res == 0) {
+            rb_replace(tree, tree->last, key, ksize, val);
+            return;
+        }
+    }
+
+    node = do_lookup(tree, key, ksize, &parent, &is_left);
+    if (node)
+        rb_replace(tree, node, key, ksize, val);
+    else
+        rb_link(tree, parent, is_left, key, ksize, val);
+}
+
+const rb_cursor_st *rbtree_insert_hint(rbtree_st *tree, const rb_cursor_st *hint,
+                                       const void *key, uint32_t ksize, void *val)
+{
+    rbtree_node_st *node = (rbtree_node_st *)hint, *adj, *parent;
+    int is_left, res;
+
+    if (!node) {
+        rbtree_insert(tree, key, ksize, val);
+        return rbtree_get_cursor(tree, key, ksize);
+    }
+
+    /*
+     * The key belongs right next to the hint if it falls between the hint
+     * and its neighbour on that side.  The free child slot between two
+     * adjacent nodes is either the hint's own or the neighbour's.
+     */
+    res = tree->cmp_fn(node->cs.key, node->cs.ksize, key, ksize);
+    if (res == 0) {
+        rb_replace(tree, node, key, ksize, val);
+        return hint;
+    }
+
+    if (res < 0) {
+        adj = rb_next(node);
+        res = adj ? tree->cmp_fn(adj->cs.key, adj->cs.ksize, key, ksize) : 1;
+        if (res > 0) {
+            node = node->right ? rb_link(tree, adj, 1, key, ksize, val)
+                               : rb_link(tree, node, 0, key, ksize, val);
+            return (const rb_cursor_st *)node;
+        }
+    } else {
+        adj = rb_prev(node);
+        res = adj ? tree->cmp_fn(adj->cs.key, adj->cs.ksize, key, ksize) : -1;
+        if (res < 0) {
+            node = node->left ? rb_link(tree, adj, 0, key, ksize, val)
+                              : rb_link(tree, node, 1, key, ksize, val);
+            return (const rb_cursor_st *)node;
+        }
+    }
+
+    if (res == 0) {
+        rb_replace(tree, adj, key, ksize, val);
+        return (const rb_cursor_st *)adj;
+    }
+
+    /* wrong hint */
+    node = do_lookup(tree, key, ksize, &parent, &is_left);
+    if (node) {
+        rb_replace(tree, node, key, ksize, val);
+        return (const rb_cursor_st *)node;
+    }
+    return (const rb_cursor_st *)rb_link(tree, parent, is_left, key, ksize, val);
 }
 
 void rbtree_delete(rbtree_st *tree, const void *key, uint32_t ksize)
@@ -406,6 +716,7 @@ void rbtree_delete(rbtree_st *tree, const void *key, uint32_t ksize)
     if (left && right) {
         color = get_color(next);
         set_color(get_color(node), next);
+        next->size = node->size;
 
         next->left = left;
         set_parent(next, left);
@@ -435,6 +746,17 @@ void rbtree_delete(rbtree_st *tree, const void *key, uint32_t ksize)
     if (node)
         set_parent(parent, node);
 
+    /*
+     * One node is gone below 'parent'; fix the subtree sizes before the
+     * rotations of the fixup rely on them.
+     */
+    if (order_stat(tree)) {
+        rbtree_node_st *p;
+
+        for (p = parent; p; p = get_parent(p))
+            p->size--;
+    }
+
     /*
      * The 'easy' cases.
      */
@@ -515,10 +837,7 @@ end_delete:
     if ((void *)tree->data_free)
         tree->data_free(oldnode->cs.data);
 
-    if (!(tree->flag & RFLAG_EXTERN_KEY))
-        free(oldnode->cs.key);
-
-    free(oldnode);
+    node_free(tree, oldnode);
     tree->nelem--;
 }
 
@@ -550,26 +869,194 @@ static void node_destroy(rbtree_st *tree, rbtree_node_st *node)
     if (node->right)
         node_destroy(tree, node->right);
 
-    if (!(tree->flag & RFLAG_EXTERN_KEY))
-        free(node->cs.key);
-
     if ((void *)tree->data_free)
         tree->data_free(node->cs.data);
 
-    free(node);
+    /* pooled nodes are released with their slabs */
+    if (tree->flag & RFLAG_NODE_POOL) {
+        if (!(tree->flag & RFLAG_EXTERN_KEY) && node_class(tree, node->cs.ksize) == 0)
+            free(node->cs.key);
+    } else {
+        node_free(tree, node);
+    }
 }
 
 void rbtree_destroy(rbtree_st *tree)
 {
+    rbtree_slab_st *slab;
+
     if (!tree)
         return;
 
-    if (tree->root)
+    /* a pooled tree with nothing to free per node skips the walk */
+    if (tree->root && (!(tree->flag & RFLAG_NODE_POOL) ||
+                       (void *)tree->data_free || tree->nkey_alloc))
         node_destroy(tree, tree->root);
 
+    while ((slab = tree->pool.slabs) != NULL) {
+        tree->pool.slabs = slab->next;
+        free(slab);
+    }
+
     free(tree);
 }
 
+/*
+ * Link nodes[lo, hi), sorted by key, into a balanced subtree.  Splitting
+ * at the middle keeps every level but the deepest full, so coloring the
+ * deepest level red and the rest black gives equal black heights.
+ */
+static rbtree_node_st *rb_build(rbtree_node_st **nodes, uint32_t lo, uint32_t hi,
+                                int depth, int red_depth, rbtree_node_st *parent)
+{
+    rbtree_node_st *node;
+    uint32_t mid;
+
+    if (lo >= hi)
+        return NULL;
+
+    mid = lo + (hi - lo) / 2;
+    node = nodes[mid];
+    set_parent(parent, node);
+    set_color(depth == red_depth ? RB_RED : RB_BLACK, node);
+    node->size = hi - lo;
+    node->left = rb_build(nodes, lo, mid, depth + 1, red_depth, node);
+    node->right = rb_build(nodes, mid + 1, hi, depth + 1, red_depth, node);
+
+    return node;
+}
+
+static void rb_build_tree(rbtree_st *tree, rbtree_node_st **nodes, uint32_t n)
+{
+    tree->root = rb_build(nodes, 0, n, 0, 31 - __builtin_clz(n), NULL);
+    set_color(RB_BLACK, tree->root);
+    tree->first = nodes[0];
+    tree->last = nodes[n - 1];
+    tree->nelem = n;
+}
+
+int rbtree_build_sorted(rbtree_st *tree, const void *const *keys, const uint32_t *ksizes,
+                        void *const *vals, uint32_t n)
+{
+    rbtree_node_st **nodes;
+    uint32_t i;
+
+    if (tree->root)
+        return -1;
+
+    for (i = 1; i < n; i++) {
+        if (tree->cmp_fn(keys[i - 1], ksizes[i - 1], keys[i], ksizes[i]) >= 0)
+            return -1;
+    }
+
+    if (n == 0)
+        return 0;
+
+    /* allocated in key order, so a pooled tree gets them back to back */
+    nodes = xnew_array(rbtree_node_st *, n);
+    for (i = 0; i < n; i++) {
+        nodes[i] = node_alloc(tree, keys[i], ksizes[i]);
+        nodes[i]->cs.data = vals ? vals[i] : NULL;
+    }
+
+    rb_build_tree(tree, nodes, n);
+    xfree(nodes);
+    return 0;
+}
+
+/* hand src's slabs and free nodes to tree, leaving src with an empty pool */
+static void pool_move(rbtree_pool_st *pool, rbtree_pool_st *src)
+{
+    rbtree_slab_st *slab;
+    rbtree_node_st *node;
+    int c;
+
+    while ((slab = src->slabs) != NULL) {
+        src->slabs = slab->next;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+    }
+
+    for (c = 0; c < RB_POOL_NCLASS; c++) {
+        while ((node = src->free[c]) != NULL) {
+            src->free[c] = node->left;
+            node->left = pool->free[c];
+            pool->free[c] = node;
+        }
+    }
+
+    pool->nbytes += src->nbytes;
+    src->nbytes = 0;
+    src->cur = src->end = NULL;
+}
+
+int rbtree_merge(rbtree_st *tree, rbtree_st *src)
+{
+    rbtree_node_st **nodes, *a, *b, *next;
+    uint32_t total, k = 0, ndup = 0;
+
+    if (tree == src || tree->cmp_fn != src->cmp_fn ||
+        ((tree->flag ^ src->flag) & (RFLAG_EXTERN_KEY | RFLAG_NODE_POOL)))
+        return -1;
+
+    if (!src->root)
+        return 0;
+
+    total = tree->nelem + src->nelem;
+    nodes = xnew_array(rbtree_node_st *, total);
+
+    /*
+     * Merge the two in-order sequences.  On equal keys src's value wins,
+     * as with rbtree_insert(); the src node is parked at the end of the
+     * array and only freed after the walk, since later rb_next() calls
+     * may still climb through it.
+     */
+    a = tree->first;
+    b = src->first;
+    while (a || b) {
+        int res = !a ? 1 : !b ? -1 : tree->cmp_fn(a->cs.key, a->cs.ksize, b->cs.key, b->cs.ksize);
+
+        if (res < 0) {
+            nodes[k++] = a;
+            a = rb_next(a);
+        } else if (res > 0) {
+            nodes[k++] = b;
+            b = rb_next(b);
+        } else {
+            if ((void *)tree->data_free)
+                tree->data_free(a->cs.data);
+            if (tree->flag & RFLAG_EXTERN_KEY) {
+                a->cs.key = b->cs.key;
+                a->cs.ksize = b->cs.ksize;
+            }
+            a->cs.data = b->cs.data;
+            nodes[k++] = a;
+            a = rb_next(a);
+
+            next = rb_next(b);
+            nodes[total - ++ndup] = b;
+            b = next;
+        }
+    }
+
+    tree->nkey_alloc += src->nkey_alloc;
+    tree->nbytes += src->nbytes;
+    if (tree->flag & RFLAG_NODE_POOL)
+        pool_move(&tree->pool, &src->pool);
+
+    while (ndup)
+        node_free(tree, nodes[total - ndup--]);
+
+    rb_build_tree(tree, nodes, k);
+    xfree(nodes);
+
+    src->root = src->first = src->last = NULL;
+    src->nelem = 0;
+    src->nkey_alloc = 0;
+    src->nbytes = 0;
+    return 0;
+}
+
 uint32_t rbtree_count(rbtree_st *rb)
 {
     return rb->nelem;
@@ -593,5 +1080,286 @@ int rbtree_foreach(rbtree_st *rb, void *data, rbtree_foreach_func_t fn)
 
 uint32_t rbtree_size(rbtree_st *rb)
 {
-    return rb->nelem * sizeof(rbtree_node_st);
+    return rb->nbytes + rb->pool.nbytes;
+}
+
+#ifdef TEST_RBTREE
+
+#include <stdio.h>
+
+#define UNIVERSE 3000
+
+/*
+ * Key i is its 8-digit index followed by i % 80 padding bytes, so keys
+ * sort by index while their sizes cover every inline class and keys too
+ * long to inline.
+ */
+static char keys[UNIVERSE][96];
+static uint32_t ksizes[UNIVERSE];
+static char present[UNIVERSE];
+
+#define VAL(i) ((void *)(uintptr_t)((i) + 1))
+#define IDX(cs) ((int)(uintptr_t)(cs)->data - 1)
+
+/* check parent links, colors, black height and subtree sizes; returns the black height */
+static int validate(const rbtree_st *tree, const rbtree_node_st *node, const rbtree_node_st *parent,
+                    uint32_t *count)
+{
+    uint32_t nl, nr;
+    int bl, br;
+
+    if (!node) {
+        *count = 0;
+        return 1;
+    }
+
+    if (node->parent != parent)
+        return -1;
+    if (is_red(node) && ((node->left && is_red(node->left)) || (node->right && is_red(node->right))))
+        return -1;
+
+    bl = validate(tree, node->left, node, &nl);
+    br = validate(tree, node->right, node, &nr);
+    if (bl < 0 || bl != br)
+        return -1;
+
+    *count = nl + nr + 1;
+    if ((tree->flag & RFLAG_ORDER_STAT) && node->size != *count)
+        return -1;
+
+    return bl + is_black(node);
+}
+
+static int check_tree(const rbtree_st *tree)
+{
+    uint32_t count, n = 0, i;
+    const rb_cursor_st *cs;
+    int last = -1;
+
+    if (validate(tree, tree->root, NULL, &count) < 0 || (tree->root && is_red(tree->root)))
+        return printf("FAIL red-black invariants\n"), 1;
+    if (count != tree->nelem)
+        return printf("FAIL count %u, nelem %u\n", count, tree->nelem), 1;
+    if (tree->root ? tree->first != get_first(tree->root) || tree->last != get_last(tree->root)
+                   : tree->first || tree->last)
+        return printf("FAIL first/last\n"), 1;
+
+    for (i = 0; i < UNIVERSE; i++)
+        n += present[i];
+    if (n != count)
+        return printf("FAIL tree has %u keys, model %u\n", count, n), 1;
+
+    for (cs = rbtree_first(tree); cs; cs = rbtree_next(cs)) {
+        if (IDX(cs) <= last || !present[IDX(cs)] || cs->ksize != ksizes[IDX(cs)] ||
+            memcmp(cs->key, keys[IDX(cs)], cs->ksize))
+            return printf("FAIL in-order walk at %d\n", IDX(cs)), 1;
+        last = IDX(cs);
+    }
+
+    return 0;
+}
+
+struct range_ctx {
+    int next; /* index the next callback must report */
+    int hi;   /* one past the last index in range */
+    int bad;
+};
+
+static int model_next(int i)
+{
+    while (i < UNIVERSE && !present[i])
+        i++;
+    return i;
+}
+
+static int range_cb(const void *key, int ksize, void *val, void *userdata)
+{
+    struct range_ctx *ctx = userdata;
+    int i = (int)(uintptr_t)val - 1;
+
+    (void)key;
+    ctx->next = model_next(ctx->next);
+    if (i != ctx->next || ctx->next >= ctx->hi || (uint32_t)ksize != ksizes[i])
+        ctx->bad = 1;
+    ctx->next++;
+    return 0;
+}
+
+/* compare bounds, cursor steps, rank/select and ranges around key i */
+static int check_queries(rbtree_st *tree, int i, unsigned *seed)
+{
+    const rb_cursor_st *cs;
+    int lo, hi, j;
+    uint32_t rank;
+
+    for (lo = i; lo < UNIVERSE && !present[lo]; lo++)
+        ;
+    for (hi = i; hi >= 0 && !present[hi]; hi--)
+        ;
+
+    cs = rbtree_lower_bound(tree, keys[i], ksizes[i]);
+    if (lo < UNIVERSE ? !cs || IDX(cs) != lo : cs != NULL)
+        return printf("FAIL lower_bound %d\n", i), 1;
+    cs = rbtree_upper_bound(tree, keys[i], ksizes[i]);
+    if (hi >= 0 ? !cs || IDX(cs) != hi : cs != NULL)
+        return printf("FAIL upper_bound %d\n", i), 1;
+    cs = rbtree_get_cursor(tree, keys[i], ksizes[i]);
+    if (present[i] ? !cs || IDX(cs) != i : cs != NULL)
+        return printf("FAIL get_cursor %d\n", i), 1;
+    if (cs) {
+        const rb_cursor_st *prev = rbtree_prev(cs), *next = rbtree_next(cs);
+
+        for (j = i - 1; j >= 0 && !present[j]; j--)
+            ;
+        if (j >= 0 ? !prev || IDX(prev) != j : prev != NULL)
+            return printf("FAIL prev of %d\n", i), 1;
+        j = model_next(i + 1);
+        if (j < UNIVERSE ? !next || IDX(next) != j : next != NULL)
+            return printf("FAIL next of %d\n", i), 1;
+    }
+
+    if (tree->flag & RFLAG_ORDER_STAT) {
+        uint32_t below = 0;
+
+        for (j = 0; j < i; j++)
+            below += present[j];
+        if (rbtree_rank(tree, keys[i], ksizes[i], &rank) != 0 || rank != below)
+            return printf("FAIL rank %d\n", i), 1;
+        cs = rbtree_select(tree, below);
+        if (lo < UNIVERSE ? !cs || IDX(cs) != lo : cs != NULL)
+            return printf("FAIL select %u\n", below), 1;
+    } else if (rbtree_select(tree, 0) || rbtree_rank(tree, keys[i], ksizes[i], &rank) != -1) {
+        return printf("FAIL order statistics without RFLAG_ORDER_STAT\n"), 1;
+    }
+
+    /* a range starting at key i, in all four inclusion modes */
+    j = i + (int)(rand_r(seed) % 200);
+    if (j >= UNIVERSE)
+        j = UNIVERSE - 1;
+    for (int flag = 0; flag < 4; flag++) {
+        struct range_ctx ctx = {i + !!(flag & RB_RANGE_EXCL_LO), j + !(flag & RB_RANGE_EXCL_HI), 0};
+
+        rbtree_range(tree, keys[i], ksizes[i], keys[j], ksizes[j], flag, &ctx, range_cb);
+        if (ctx.bad || model_next(ctx.next) < ctx.hi)
+            return printf("FAIL range [%d, %d] flag %d\n", i, j, flag), 1;
+    }
+
+    return 0;
+}
+
+static int insert_model(rbtree_st *tree, int i, const rb_cursor_st **hint, unsigned *seed)
+{
+    switch (rand_r(seed) % 3) {
+    case 0:
+        rbtree_insert(tree, keys[i], ksizes[i], VAL(i));
+        break;
+    case 1:
+        /* the previous result, which is adjacent when keys come in order */
+        *hint = rbtree_insert_hint(tree, *hint, keys[i], ksizes[i], VAL(i));
+        if (!*hint || IDX(*hint) != i)
+            return printf("FAIL insert_hint %d\n", i), 1;
+        break;
+    default:
+        /* an arbitrary hint, which must still give a correct tree */
+        rbtree_insert_hint(tree, rbtree_lower_bound(tree, keys[rand_r(seed) % UNIVERSE], 8),
+                           keys[i], ksizes[i], VAL(i));
+        break;
+    }
+
+    present[i] = 1;
+    return 0;
+}
+
+/*
+ * Move a random subset of the model into a tree built with
+ * rbtree_build_sorted() and merge it back; some keys are in both trees.
+ */
+static int check_build_merge(rbtree_st *tree, unsigned *seed)
+{
+    const void **bk = xnew_array(const void *, UNIVERSE);
+    uint32_t *bs = xnew_array(uint32_t, UNIVERSE);
+    void **bv = xnew_array(void *, UNIVERSE);
+    rbtree_st *src = rbtree_create(NULL, NULL, tree->flag);
+    uint32_t n = 0, count;
+    int ret = 0;
+
+    for (int i = 0; i < UNIVERSE; i++) {
+        if (rand_r(seed) % 4)
+            continue;
+        bk[n] = keys[i];
+        bs[n] = ksizes[i];
+        bv[n++] = VAL(i);
+        present[i] = 1;
+    }
+
+    if (rbtree_build_sorted(src, bk, bs, bv, n) != 0 || rbtree_count(src) != n ||
+        validate(src, src->root, NULL, &count) < 0 || (src->root && is_red(src->root)))
+        ret = (printf("FAIL build_sorted of %u keys\n", n), 1);
+    if (n > 1 && rbtree_build_sorted(src, bk, bs, bv, n) != -1)
+        ret = (printf("FAIL build_sorted into a non-empty tree\n"), 1);
+    if (rbtree_merge(tree, tree) != -1 || rbtree_merge(tree, src) != 0 || rbtree_count(src) != 0)
+        ret = (printf("FAIL merge\n"), 1);
+
+    rbtree_destroy(src);
+    xfree(bk);
+    xfree(bs);
+    xfree(bv);
+    return ret || check_tree(tree);
+}
+
+int main(void)
+{
+    for (int i = 0; i < UNIVERSE; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "%08d", i);
+        memset(keys[i] + 8, 'x', i % 80);
+        ksizes[i] = 8 + i % 80;
+    }
+
+    /* every combination of RFLAG_EXTERN_KEY, RFLAG_NODE_POOL and RFLAG_ORDER_STAT */
+    for (int flag = 0; flag < 8; flag++) {
+        rbtree_st *tree = rbtree_create(NULL, NULL, flag);
+        const rb_cursor_st *hint = NULL;
+        unsigned seed = (unsigned)flag + 1;
+
+        memset(present, 0, sizeof(present));
+
+        for (int op = 0; op < 40000; op++) {
+            int i = rand_r(&seed) % UNIVERSE;
+
+            /* runs of ascending keys exercise the append path and adjacent hints */
+            if (op % 5000 < 500)
+                i = op % 5000 * 6 % UNIVERSE;
+
+            if (rand_r(&seed) % 100 < (op < 20000 ? 65 : 35)) {
+                if (insert_model(tree, i, &hint, &seed))
+                    return 1;
+            } else {
+                rbtree_delete(tree, keys[i], ksizes[i]);
+                present[i] = 0;
+                hint = NULL;
+            }
+
+            if (check_queries(tree, rand_r(&seed) % UNIVERSE, &seed))
+                return printf("  flag %d op %d\n", flag, op), 1;
+            if (op % 1000 == 0 && check_tree(tree))
+                return printf("  flag %d op %d\n", flag, op), 1;
+            if (op % 10000 == 5000) {
+                if (check_build_merge(tree, &seed))
+                    return printf("  flag %d op %d\n", flag, op), 1;
+                hint = NULL;
+            }
+        }
+
+        for (int i = 0; i < UNIVERSE; i++) {
+            rbtree_delete(tree, keys[i], ksizes[i]);
+            present[i] = 0;
+        }
+        if (check_tree(tree) || tree->root || (!(flag & RFLAG_NODE_POOL) && rbtree_size(tree) != 0))
+            return printf("FAIL drain with flag %d\n", flag), 1;
+        rbtree_destroy(tree);
+    }
+
+    printf("ok\n");
+    return 0;
 }
+#endif /* TEST_RBTREE */
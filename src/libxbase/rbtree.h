@@ -37,11 +37,25 @@ typedef void (*rbtree_data_free_func_t)(void *data);
  */
 #define RFLAG_EXTERN_KEY 0x1
 
+/**
+ * @brief Flag indicating that nodes should come from a per-tree pool: slabs
+ *        carved with a bump pointer, with one free list per node size class.
+ *        Freed nodes are reused by later inserts; the memory goes back to the
+ *        system only when the tree is destroyed.
+ */
+#define RFLAG_NODE_POOL 0x2
+
+/**
+ * @brief Flag indicating that every node should track the size of its subtree,
+ *        which makes rbtree_select() and rbtree_rank() O(log n)
+ */
+#define RFLAG_ORDER_STAT 0x4
+
 /**
  * @brief Create a new red-black tree
  * @param data_free Function pointer for freeing data associated with a node
  * @param cmp Function pointer for comparing two keys
- * @param flag Flag indicating whether to use external memory for keys
+ * @param flag RFLAG_EXTERN_KEY, RFLAG_NODE_POOL and/or RFLAG_ORDER_STAT
  * @return Pointer to the newly created red-black tree
  */
 rbtree_st *rbtree_create(rbtree_data_free_func_t data_free, rbtree_cmp_func_t cmp, int flag);
@@ -134,7 +148,26 @@ const rb_cursor_st *rbtree_lower_bound(const rbtree_st *rb, const void *key, uin
 const rb_cursor_st *rbtree_upper_bound(const rbtree_st *rb, const void *key, uint32_t ksize);
 
 /**
- * @brief Insert a node with a given key and value into a red-black tree
+ * @brief Get the cursor for the k-th smallest key of a tree created with RFLAG_ORDER_STAT
+ * @param rb Pointer to the red-black tree
+ * @param k Zero-based rank of the key
+ * @return Pointer to the cursor for the node, or NULL if k is out of range or the tree has no order statistics
+ */
+const rb_cursor_st *rbtree_select(const rbtree_st *rb, uint32_t k);
+
+/**
+ * @brief Count the keys less than a given key in a tree created with RFLAG_ORDER_STAT
+ * @param rb Pointer to the red-black tree
+ * @param key Pointer to the key, which need not be in the tree
+ * @param ksize Size of the key
+ * @param rank Pointer to a variable to store the count
+ * @return 0 on success, -1 if the tree has no order statistics
+ */
+int rbtree_rank(const rbtree_st *rb, const void *key, uint32_t ksize, uint32_t *rank);
+
+/**
+ * @brief Insert a node with a given key and value into a red-black tree.
+ *        A key greater than the current last key is appended without a descent.
  * @param rb Pointer to the red-black tree
  * @param key Pointer to the key to insert
  * @param ksize Size of the key
@@ -142,6 +175,20 @@ const rb_cursor_st *rbtree_upper_bound(const rbtree_st *rb, const void *key, uin
  */
 void rbtree_insert(rbtree_st *rb, const void *key, uint32_t ksize, void *val);
 
+/**
+ * @brief Insert a node next to a hint, in amortized O(1) when the key falls
+ *        between the hint and its neighbour; otherwise like rbtree_insert()
+ * @param rb Pointer to the red-black tree
+ * @param hint Cursor of a node adjacent to where the key goes, e.g. the one
+ *             returned by the previous call, or NULL
+ * @param key Pointer to the key to insert
+ * @param ksize Size of the key
+ * @param val Pointer to the value to insert
+ * @return Pointer to the cursor for the inserted or updated node
+ */
+const rb_cursor_st *rbtree_insert_hint(rbtree_st *rb, const rb_cursor_st *hint,
+                                       const void *key, uint32_t ksize, void *val);
+
 /**
  * @brief Delete a node with a given key from a red-black tree
  * @param rb Pointer to the red-black tree
@@ -150,6 +197,28 @@ void rbtree_insert(rbtree_st *rb, const void *key, uint32_t ksize, void *val);
  */
 void rbtree_delete(rbtree_st *rb, const void *key, uint32_t ksize);
 
+/**
+ * @brief Build an empty red-black tree from keys in strictly ascending order in O(n)
+ * @param rb Pointer to the red-black tree, which must be empty
+ * @param keys Array of n pointers to the keys
+ * @param ksizes Array of n key sizes
+ * @param vals Array of n values, or NULL to store NULL values
+ * @param n Number of keys
+ * @return 0 on success, -1 if the tree is not empty or the keys are not strictly ascending
+ */
+int rbtree_build_sorted(rbtree_st *rb, const void *const *keys, const uint32_t *ksizes,
+                        void *const *vals, uint32_t n);
+
+/**
+ * @brief Move every node of src into rb in O(n + m), rebuilding rb balanced.
+ *        On equal keys the value from src replaces the one in rb.
+ * @param rb Pointer to the destination red-black tree
+ * @param src Pointer to the source red-black tree, empty afterwards but still to be destroyed
+ * @return 0 on success, -1 if rb and src are the same tree, use different
+ *         comparators or differ in RFLAG_EXTERN_KEY or RFLAG_NODE_POOL
+ */
+int rbtree_merge(rbtree_st *rb, rbtree_st *src);
+
 /**
  * @brief Function pointer type for iterating over a red-black tree
  * @param key Pointer to the key of the current node
@@ -170,7 +239,35 @@ typedef int (*rbtree_foreach_func_t)(const void *key, int ksize, void *val, void
 int rbtree_foreach(rbtree_st *rb, void *userdata, rbtree_foreach_func_t fn);
 
 /**
- * @brief Get the size of a red-black tree in bytes, not including the memory used by keys and values
+ * @brief Flag for rbtree_range() excluding a key equal to the lower bound
+ */
+#define RB_RANGE_EXCL_LO 0x1
+
+/**
+ * @brief Flag for rbtree_range() excluding a key equal to the upper bound
+ */
+#define RB_RANGE_EXCL_HI 0x2
+
+/**
+ * @brief Call a function for each node with a key between two bounds, in key order
+ * @param rb Pointer to the red-black tree
+ * @param lo Pointer to the lower bound, or NULL to start from the first node
+ * @param lo_size Size of the lower bound
+ * @param hi Pointer to the upper bound, or NULL to run to the last node
+ * @param hi_size Size of the upper bound
+ * @param flag RB_RANGE_EXCL_LO and/or RB_RANGE_EXCL_HI, 0 for an inclusive range
+ * @param userdata Pointer to user-defined data to pass to the function
+ * @param fn Function to call for each node, it must not modify the tree
+ * @return 0 if the iteration completes successfully, or the non-zero value returned by the function if it stops the iteration early
+ */
+int rbtree_range(rbtree_st *rb, const void *lo, uint32_t lo_size,
+                 const void *hi, uint32_t hi_size, int flag,
+                 void *userdata, rbtree_foreach_func_t fn);
+
+/**
+ * @brief Get the memory allocated for a red-black tree's nodes in bytes, including
+ *        inline keys and, with RFLAG_NODE_POOL, whole slabs; keys allocated
+ *        separately and values are not counted
  * @param rb Pointer to the red-black tree
  * @return The size of the tree in bytes
  */
@@ -1,35 +1,73 @@
-
-#include "list.h"
 #include "xmalloc.h"
 #include "stack.h"
 
-typedef struct {
-    list_t list;
-    void *data;
-} stack_node_t;
-
-struct stack_st {
-    list_t list;
-    size_t size;
-};
+#ifdef TEST_STACK
+/* 基准测试统计栈自身的分配次数 */
+static size_t stack_nalloc;
+static void *stack_counted(void *ptr)
+{
+    stack_nalloc++;
+    return ptr;
+}
+#define xmalloc(size) stack_counted(xmalloc(size))
+#define xrealloc(ptr, size) stack_counted(xrealloc(ptr, size))
+#endif
 
 stack_t *stack_new()
 {
     stack_t *stack = xnew(stack_t);
 
-    list_init(&stack->list);
-    stack->size = 0;
+    stack_init(stack);
 
     return stack;
 }
 
+void stack_init(stack_t *stack)
+{
+    stack->items = stack->inline_items;
+    stack->size = 0;
+    stack->cap = STACK_INLINE;
+}
+
+void stack_destroy(stack_t *stack)
+{
+    if (stack->items != stack->inline_items)
+        xfree(stack->items);
+    stack_init(stack);
+}
+
+void stack_reserve(stack_t *stack, size_t n)
+{
+    size_t cap = stack->cap;
+
+    if (n <= cap)
+        return;
+
+    while (cap < n)
+        cap *= 2;
+
+    if (stack->items == stack->inline_items) {
+        stack->items = xnew_array(void *, cap);
+        memcpy(stack->items, stack->inline_items, stack->size * sizeof(void *));
+    } else {
+        stack->items = xrealloc(stack->items, cap * sizeof(void *));
+    }
+    stack->cap = cap;
+}
+
 void stack_push(stack_t *stack, void *data)
 {
-    stack_node_t *node = xnew(stack_node_t);
-    list_init(&node->list);
-    node->data = data;
-    list_add_head(&stack->list, &node->list);
-    stack->size++;
+    if (stack->size == stack->cap)
+        stack_reserve(stack, stack->size + 1);
+
+    stack->items[stack->size++] = data;
+}
+
+void stack_push_n(stack_t *stack, void *const *data, size_t n)
+{
+    stack_reserve(stack, stack->size + n);
+    memcpy(stack->items + stack->size, data, n * sizeof(void *));
+    stack->size += n;
 }
 
 void *stack_pop(stack_t *stack)
@@ -37,11 +75,19 @@ void *stack_pop(stack_t *stack)
     if (stack->size == 0)
         return NULL;
 
-    stack_node_t *node = (stack_node_t *)list_pop_head(&stack->list);
-    void *data = node->data;
-    xfree(node);
-    stack->size--;
-    return data;
+    return stack->items[--stack->size];
+}
+
+size_t stack_pop_n(stack_t *stack, void **out, size_t n)
+{
+    if (n > stack->size)
+        n = stack->size;
+
+    for (size_t i = 0; i < n; i++)
+        out[i] = stack->items[stack->size - 1 - i];
+    stack->size -= n;
+
+    return n;
 }
 
 void *stack_top(stack_t *stack)
@@ -49,8 +95,7 @@ void *stack_top(stack_t *stack)
     if (stack->size == 0)
         return NULL;
 
-    stack_node_t *node = (stack_node_t *)list_head(&stack->list);
-    return node->data;
+    return stack->items[stack->size - 1];
 }
 
 size_t stack_size(stack_t *stack)
@@ -65,12 +110,70 @@ bool stack_empty(stack_t *stack)
 
 void stack_clear(stack_t *stack)
 {
-	while (stack_pop(stack))
-		;
+    stack->size = 0;
 }
 
 void stack_free(stack_t *stack)
 {
-	stack_clear(stack);
+    if (!stack)
+        return;
+
+    stack_destroy(stack);
     xfree(stack);
-}
\ No newline at end of file
+}
+
+#ifdef TEST_STACK
+
+#include <stdio.h>
+#include <time.h>
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 模拟深度优先遍历：反复压入一批再弹空，稳定后不应再分配内存 */
+int main(void)
+{
+    const int rounds = 100000, width = 1000;
+    void *batch[64];
+    stack_t st;
+    size_t sum = 0, warm = 0;
+
+    stack_init(&st);
+
+    double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < width; i++)
+            stack_push(&st, (void *)(size_t)(i + 1));
+        while (!stack_empty(&st))
+            sum += (size_t)stack_pop(&st);
+        if (r == 0)
+            warm = stack_nalloc;
+    }
+    double t1 = now();
+
+    printf("push/pop %d x %d: %.2f ns/op, %zu allocations (%zu after first round)\n", rounds, width,
+           (t1 - t0) * 1e9 / (2.0 * rounds * width), stack_nalloc, stack_nalloc - warm);
+
+    for (size_t i = 0; i < 64; i++)
+        batch[i] = (void *)(i + 1);
+
+    t0 = now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < width / 64; i++)
+            stack_push_n(&st, batch, 64);
+        while (stack_pop_n(&st, batch, 64) == 64)
+            sum += (size_t)batch[0];
+    }
+    t1 = now();
+
+    printf("bulk push/pop of 64: %.2f ns/element, %zu allocations total (%zu)\n",
+           (t1 - t0) * 1e9 / (2.0 * rounds * (width / 64) * 64), stack_nalloc, sum);
+
+    stack_destroy(&st);
+    return 0;
+}
+#endif /* TEST_STACK */
@@ -5,18 +5,53 @@
 #include <stdlib.h>
 
 /**
- * 栈结构体
+ * 内嵌数组的容量，元素不超过这个数时栈不分配内存
  */
+#define STACK_INLINE 8
+
+/**
+ * 栈结构体，元素存放在连续的数组中，容量不够时按两倍扩展，弹出时不收缩。
+ * 可以直接嵌入其他结构体或放在调用者的栈上，用 stack_init 初始化，
+ * 此时 items 可能指向结构体自身，不能按值复制。
+ */
+struct stack_st {
+    void **items; /**< 元素数组，指向 inline_items 或堆上的数组 */
+    size_t size;  /**< 元素个数 */
+    size_t cap;   /**< 数组容量 */
+    void *inline_items[STACK_INLINE];
+};
+
 typedef struct stack_st stack_t;
 
 /**
  * 创建一个新的栈
  *
- * @param fun 释放函数指针
  * @return 新的栈
  */
 stack_t *stack_new();
 
+/**
+ * 初始化一个由调用者提供内存的栈
+ *
+ * @param stack 栈
+ */
+void stack_init(stack_t *stack);
+
+/**
+ * 释放 stack_init 初始化的栈的数组，不释放栈本身
+ *
+ * @param stack 栈
+ */
+void stack_destroy(stack_t *stack);
+
+/**
+ * 预留容量，之后压入不超过 n 个元素时不再分配内存
+ *
+ * @param stack 栈
+ * @param n 元素个数
+ */
+void stack_reserve(stack_t *stack, size_t n);
+
 /**
  * 将一个元素压入栈中
  *
@@ -25,14 +60,33 @@ stack_t *stack_new();
  */
 void stack_push(stack_t *stack, void *data);
 
+/**
+ * 依次将 n 个元素压入栈中，data[n - 1] 成为栈顶
+ *
+ * @param stack 栈
+ * @param data 数据指针数组
+ * @param n 元素个数
+ */
+void stack_push_n(stack_t *stack, void *const *data, size_t n);
+
 /**
  * 从栈中弹出一个元素，并返回其值
  *
  * @param stack 栈
- * @return 栈顶元素的值
+ * @return 栈顶元素的值，栈为空时返回NULL
  */
 void *stack_pop(stack_t *stack);
 
+/**
+ * 弹出至多 n 个元素，按弹出顺序写入 out，out[0] 是原来的栈顶
+ *
+ * @param stack 栈
+ * @param out 输出数组
+ * @param n 最多弹出的个数
+ * @return 实际弹出的个数
+ */
+size_t stack_pop_n(stack_t *stack, void **out, size_t n);
+
 /**
  * 返回栈顶元素的值
  *
@@ -58,7 +112,7 @@ size_t stack_size(stack_t *stack);
 bool stack_empty(stack_t *stack);
 
 /**
- * 清除栈
+ * 清除栈，保留已分配的容量
  *
  * @param stack 栈
  */
@@ -0,0 +1,653 @@
+#define _GNU_SOURCE
+
+#include "thpool.h"
+#include "lfstack.h"
+#include "list.h"
+#include "xmalloc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define THPOOL_DEQUE_INIT 256 /* 双端队列的初始容量 */
+#define THPOOL_TASK_BLOCK 64  /* 任务句柄按块分配，线程池释放时统一回收 */
+#define THPOOL_SPIN 64        /* 找不到任务时让出CPU的次数，之后睡眠 */
+#define THPOOL_MAX_NODES 64
+
+struct thpool_task {
+    thpool_fn_t fn;
+    void *arg;
+    int done;
+
+    list_t link;          /* 非工作线程派生时挂在注入队列上 */
+    lfstack_node_t free;  /* 回收后挂在空闲链表上 */
+};
+
+struct thpool_block {
+    struct thpool_block *next;
+    thpool_task_t tasks[THPOOL_TASK_BLOCK];
+};
+
+/* 扩容后旧数组可能仍有窃取者在读，挂在 prev 上直到线程池释放 */
+struct thpool_array {
+    int64_t size;
+    struct thpool_array *prev;
+    thpool_task_t *buf[];
+};
+
+/* top 由窃取者修改，bottom 只由所有者修改，两者在不同的缓存行 */
+struct thpool_worker {
+    int64_t top;
+    char pad0[64 - sizeof(int64_t)];
+
+    int64_t bottom;
+    struct thpool_array *array;
+
+    thpool_t *pool;
+    pthread_t tid;
+    int id;
+    int node;
+    int cpu;  /* 绑定的CPU，-1 表示不绑定 */
+    unsigned seed;
+} __attribute__((aligned(64)));
+
+struct thpool {
+    struct thpool_worker *workers;
+    int nworker;
+
+    lfstack_t free_tasks;
+    struct thpool_block *blocks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    list_t inject;   /* 受 lock 保护 */
+    int ninject;
+    int64_t pending; /* 已派生、尚未开始执行的任务数 */
+    int nsleep;
+    int stop;
+};
+
+static __thread struct thpool_worker *thpool_self;
+
+static thpool_task_t *thpool_task_alloc(thpool_t *pool)
+{
+    lfstack_node_t *node = lfstack_pop(&pool->free_tasks);
+    struct thpool_block *blk;
+
+    if (node)
+        return lfstack_entry(node, thpool_task_t, free);
+
+    blk = xnew0(struct thpool_block);
+    pthread_mutex_lock(&pool->lock);
+    blk->next = pool->blocks;
+    pool->blocks = blk;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < THPOOL_TASK_BLOCK; i++)
+        lfstack_push(&pool->free_tasks, &blk->tasks[i].free);
+
+    return &blk->tasks[0];
+}
+
+static void thpool_task_release(thpool_t *pool, thpool_task_t *task)
+{
+    lfstack_push(&pool->free_tasks, &task->free);
+}
+
+/* Chase-Lev 双端队列，内存序按 Lê 等人针对弱内存模型的版本 */
+
+static struct thpool_array *deque_array_new(int64_t size)
+{
+    struct thpool_array *a = xmalloc(sizeof(struct thpool_array) + size * sizeof(thpool_task_t *));
+
+    a->size = size;
+    a->prev = NULL;
+    return a;
+}
+
+static struct thpool_array *deque_grow(struct thpool_worker *w, struct thpool_array *a, int64_t t, int64_t b)
+{
+    struct thpool_array *na = deque_array_new(a->size * 2);
+
+    for (int64_t i = t; i < b; i++)
+        na->buf[i & (na->size - 1)] = __atomic_load_n(&a->buf[i & (a->size - 1)], __ATOMIC_RELAXED);
+    na->prev = a;
+
+    __atomic_store_n(&w->array, na, __ATOMIC_RELEASE);
+    return na;
+}
+
+static void deque_push(struct thpool_worker *w, thpool_task_t *task)
+{
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    struct thpool_array *a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+
+    if (b - t > a->size - 1)
+        a = deque_grow(w, a, t, b);
+
+    __atomic_store_n(&a->buf[b & (a->size - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+static thpool_task_t *deque_take(struct thpool_worker *w)
+{
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+    struct thpool_array *a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+    thpool_task_t *task = NULL;
+    int64_t t;
+
+    __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+
+    if (t <= b) {
+        task = __atomic_load_n(&a->buf[b & (a->size - 1)], __ATOMIC_RELAXED);
+        if (t == b) {
+            /* 最后一个任务，与窃取者竞争 */
+            if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, false,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                task = NULL;
+            __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+static thpool_task_t *deque_steal(struct thpool_worker *w)
+{
+    int64_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    int64_t b;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+
+    if (t < b) {
+        struct thpool_array *a = __atomic_load_n(&w->array, __ATOMIC_ACQUIRE);
+        thpool_task_t *task = __atomic_load_n(&a->buf[t & (a->size - 1)], __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(&w->top, &t, t + 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            return task;
+    }
+
+    return NULL;
+}
+
+/* 从随机位置开始轮询其他线程，NUMA 模式下先试同一节点的线程 */
+static thpool_task_t *thpool_steal(thpool_t *pool, struct thpool_worker *self)
+{
+    int n = pool->nworker;
+    int start = self ? (int)(rand_r(&self->seed) % (unsigned)n) : 0;
+    thpool_task_t *task;
+
+    for (int pass = self && self->cpu >= 0 ? 0 : 1; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            struct thpool_worker *w = &pool->workers[(start + i) % n];
+
+            if (w == self || (pass == 0 && w->node != self->node))
+                continue;
+            if ((task = deque_steal(w)) != NULL)
+                return task;
+        }
+    }
+
+    return NULL;
+}
+
+static thpool_task_t *thpool_inject_pop(thpool_t *pool)
+{
+    list_t *link = NULL;
+
+    if (__atomic_load_n(&pool->ninject, __ATOMIC_ACQUIRE) == 0)
+        return NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if ((link = list_pop_head(&pool->inject)) != NULL)
+        __atomic_fetch_sub(&pool->ninject, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+
+    return link ? list_entry(link, thpool_task_t, link) : NULL;
+}
+
+static thpool_task_t *thpool_find(thpool_t *pool, struct thpool_worker *self)
+{
+    thpool_task_t *task = self ? deque_take(self) : NULL;
+
+    if (task == NULL)
+        task = thpool_steal(pool, self);
+    if (task == NULL)
+        task = thpool_inject_pop(pool);
+    if (task)
+        __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_RELAXED);
+
+    return task;
+}
+
+static void thpool_run(thpool_task_t *task)
+{
+    task->fn(task->arg);
+    __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+static void thpool_pin(struct thpool_worker *w)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (w->cpu < 0)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)w;
+#endif
+}
+
+static void *thpool_worker_main(void *arg)
+{
+    struct thpool_worker *w = arg;
+    thpool_t *pool = w->pool;
+    int idle = 0;
+
+    thpool_self = w;
+    thpool_pin(w);
+
+    for (;;) {
+        thpool_task_t *task = thpool_find(pool, w);
+
+        if (task) {
+            thpool_run(task);
+            idle = 0;
+            continue;
+        }
+
+        if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+            break;
+
+        if (++idle < THPOOL_SPIN) {
+            sched_yield();
+            continue;
+        }
+
+        /* 与 thpool_spawn 配对：先登记睡眠再检查 pending，派生者先增加 pending 再检查睡眠者 */
+        pthread_mutex_lock(&pool->lock);
+        __atomic_fetch_add(&pool->nsleep, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) <= 0 && !pool->stop)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        __atomic_fetch_sub(&pool->nsleep, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&pool->lock);
+        idle = 0;
+    }
+
+    return NULL;
+}
+
+#ifdef __linux__
+/* 解析 "0-3,8-11" 形式的CPU列表 */
+static int thpool_parse_cpulist(const char *path, cpu_set_t *set)
+{
+    FILE *fp = fopen(path, "r");
+    unsigned lo, hi;
+    int c;
+
+    CPU_ZERO(set);
+    if (fp == NULL)
+        return -1;
+
+    while (fscanf(fp, "%u", &lo) == 1) {
+        hi = lo;
+        if ((c = fgetc(fp)) == '-') {
+            if (fscanf(fp, "%u", &hi) != 1)
+                break;
+            c = fgetc(fp);
+        }
+        for (unsigned cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        if (c != ',')
+            break;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/* 把工作线程轮流分配到各NUMA节点，节点内依次绑定到进程允许使用的CPU */
+static void thpool_place(thpool_t *pool)
+{
+    cpu_set_t allowed, nodes[THPOOL_MAX_NODES];
+    int ids[THPOOL_MAX_NODES], count[THPOOL_MAX_NODES];
+    int nnode = 0;
+    char path[64];
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+
+    for (int id = 0; id < THPOOL_MAX_NODES; id++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        if (thpool_parse_cpulist(path, &nodes[nnode]) != 0)
+            continue;
+
+        CPU_AND(&nodes[nnode], &nodes[nnode], &allowed);
+        if ((count[nnode] = CPU_COUNT(&nodes[nnode])) > 0)
+            ids[nnode++] = id;
+    }
+
+    if (nnode == 0) {
+        nodes[0] = allowed;
+        count[0] = CPU_COUNT(&allowed);
+        ids[0] = 0;
+        nnode = 1;
+    }
+
+    for (int i = 0; i < pool->nworker; i++) {
+        struct thpool_worker *w = &pool->workers[i];
+        int k = i % nnode, nth = (i / nnode) % count[k];
+
+        w->node = ids[k];
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &nodes[k]) && nth-- == 0) {
+                w->cpu = cpu;
+                break;
+            }
+        }
+    }
+}
+#endif
+
+thpool_t *thpool_new(int nthread, int flag)
+{
+    thpool_t *pool;
+    int i;
+
+    if (nthread <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthread = ncpu > 0 ? (int)ncpu : 1;
+    }
+
+    pool = xnew0(thpool_t);
+    pool->nworker = nthread;
+    /* 每个 worker 占整数个缓存行，malloc 只保证16字节对齐 */
+    pool->workers = aligned_alloc(64, nthread * sizeof(struct thpool_worker));
+    if (!pool->workers) {
+        fprintf(stderr, "aligned_alloc: failed to allocate %zu bytes,memory exhausted.",
+                nthread * sizeof(struct thpool_worker));
+        exit(1);
+    }
+    memset(pool->workers, 0, nthread * sizeof(struct thpool_worker));
+    lfstack_init(&pool->free_tasks);
+    list_init(&pool->inject);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < nthread; i++) {
+        struct thpool_worker *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->id = i;
+        w->cpu = -1;
+        w->seed = (unsigned)i * 2654435761u + 1;
+        w->array = deque_array_new(THPOOL_DEQUE_INIT);
+    }
+
+#ifdef __linux__
+    if (flag & THPOOL_NUMA)
+        thpool_place(pool);
+#else
+    (void)flag;
+#endif
+
+    for (i = 0; i < nthread; i++) {
+        if (pthread_create(&pool->workers[i].tid, NULL, thpool_worker_main, &pool->workers[i]) != 0)
+            break;
+    }
+
+    if (i < nthread) {
+        pool->nworker = i;
+        thpool_free(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void thpool_free(thpool_t *pool)
+{
+    if (!pool)
+        return;
+
+    /* 工作线程在 stop 之后仍会执行完剩余的任务才退出 */
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nworker; i++)
+        pthread_join(pool->workers[i].tid, NULL);
+
+    for (int i = 0; i < pool->nworker; i++) {
+        struct thpool_array *a = pool->workers[i].array;
+
+        while (a) {
+            struct thpool_array *prev = a->prev;
+            xfree(a);
+            a = prev;
+        }
+    }
+
+    while (pool->blocks) {
+        struct thpool_block *blk = pool->blocks;
+        pool->blocks = blk->next;
+        xfree(blk);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    xfree(pool->workers);
+    xfree(pool);
+}
+
+int thpool_size(thpool_t *pool)
+{
+    return pool->nworker;
+}
+
+thpool_task_t *thpool_spawn(thpool_t *pool, thpool_fn_t fn, void *arg)
+{
+    struct thpool_worker *self = thpool_self;
+    thpool_task_t *task = thpool_task_alloc(pool);
+
+    task->fn = fn;
+    task->arg = arg;
+    task->done = 0;
+
+    if (self && self->pool == pool) {
+        deque_push(self, task);
+    } else {
+        list_init(&task->link);
+        pthread_mutex_lock(&pool->lock);
+        list_add_tail(&pool->inject, &task->link);
+        __atomic_fetch_add(&pool->ninject, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->nsleep, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return task;
+}
+
+void thpool_join(thpool_t *pool, thpool_task_t *task)
+{
+    struct thpool_worker *self = thpool_self && thpool_self->pool == pool ? thpool_self : NULL;
+
+    while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+        thpool_task_t *other = thpool_find(pool, self);
+
+        if (other)
+            thpool_run(other);
+        else
+            sched_yield();
+    }
+
+    thpool_task_release(pool, task);
+}
+
+struct thpool_range {
+    thpool_t *pool;
+    size_t begin, end, grain;
+    thpool_range_fn_t fn;
+    void *arg;
+};
+
+static void thpool_for(void *arg)
+{
+    struct thpool_range *r = arg;
+
+    if (r->end - r->begin <= r->grain) {
+        r->fn(r->begin, r->end, r->arg);
+        return;
+    }
+
+    /* 右半部分派生出去供其他线程窃取，左半部分在当前线程继续二分 */
+    struct thpool_range left = *r, right = *r;
+    left.end = right.begin = r->begin + (r->end - r->begin) / 2;
+
+    thpool_task_t *task = thpool_spawn(r->pool, thpool_for, &right);
+    thpool_for(&left);
+    thpool_join(r->pool, task);
+}
+
+void thpool_parallel_for(thpool_t *pool, size_t begin, size_t end, size_t grain,
+                         thpool_range_fn_t fn, void *arg)
+{
+    struct thpool_range r = {pool, begin, end, grain, fn, arg};
+
+    if (begin >= end)
+        return;
+
+    /* 默认每个线程约 8 块，给窃取留出余地 */
+    if (r.grain == 0)
+        r.grain = (end - begin) / ((size_t)pool->nworker * 8);
+    if (r.grain == 0)
+        r.grain = 1;
+
+    thpool_for(&r);
+}
+
+#ifdef TEST_THPOOL
+
+#include <math.h>
+#include <time.h>
+
+#define FIB_N 36
+#define FIB_CUTOFF 18
+#define MAP_N (1 << 24)
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long fib_serial(int n)
+{
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+struct fib_arg {
+    thpool_t *pool;
+    int n;
+    long res;
+};
+
+static void fib_task(void *arg)
+{
+    struct fib_arg *f = arg;
+
+    if (f->n < FIB_CUTOFF) {
+        f->res = fib_serial(f->n);
+        return;
+    }
+
+    struct fib_arg a = {f->pool, f->n - 1, 0}, b = {f->pool, f->n - 2, 0};
+    thpool_task_t *task = thpool_spawn(f->pool, fib_task, &a);
+
+    fib_task(&b);
+    thpool_join(f->pool, task);
+    f->res = a.res + b.res;
+}
+
+static float *map_in, *map_out;
+
+static void map_range(size_t begin, size_t end, void *arg)
+{
+    (void)arg;
+    for (size_t i = begin; i < end; i++)
+        map_out[i] = sqrtf(map_in[i]) * sinf(map_in[i]);
+}
+
+int main(void)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    long expect;
+    double t0, t1, serial_fib, serial_map;
+
+    map_in = xnew_array(float, MAP_N);
+    map_out = xnew_array(float, MAP_N);
+    for (size_t i = 0; i < MAP_N; i++)
+        map_in[i] = (float)i;
+
+    t0 = now();
+    expect = fib_serial(FIB_N);
+    t1 = now();
+    serial_fib = t1 - t0;
+
+    t0 = now();
+    map_range(0, MAP_N, NULL);
+    t1 = now();
+    serial_map = t1 - t0;
+
+    printf("serial: fib(%d) %.3fs  map %d %.3fs\n", FIB_N, serial_fib, MAP_N, serial_map);
+
+    for (int n = 1; n <= 2 * ncpu; n *= 2) {
+        for (int flag = 0; flag <= THPOOL_NUMA; flag += THPOOL_NUMA) {
+            thpool_t *pool = thpool_new(n, flag);
+            struct fib_arg f = {pool, FIB_N, 0};
+
+            t0 = now();
+            fib_task(&f);
+            t1 = now();
+            double tfib = t1 - t0;
+
+            t0 = now();
+            thpool_parallel_for(pool, 0, MAP_N, 0, map_range, NULL);
+            t1 = now();
+            double tmap = t1 - t0;
+
+            printf("threads %2d%s: fib %.3fs (x%.2f)%s  map %.3fs (x%.2f)\n", n, flag ? " numa" : "     ",
+                   tfib, serial_fib / tfib, f.res == expect ? "" : " WRONG", tmap, serial_map / tmap);
+            thpool_free(pool);
+        }
+    }
+
+    xfree(map_in);
+    xfree(map_out);
+    return 0;
+}
+#endif /* TEST_THPOOL */
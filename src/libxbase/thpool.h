@@ -0,0 +1,96 @@
+/**
+ * @file thpool.h
+ * @brief 工作窃取线程池
+ *
+ * 每个工作线程有自己的Chase-Lev双端队列：在工作线程中派生的任务压入自己队列的底部，
+ * 自己从底部取(后进先出，缓存局部性好)，空闲的线程从其他队列的顶部窃取。
+ * 非工作线程派生的任务进入一个加锁的注入队列。等待任务完成时，
+ * 等待者会先执行其他任务，所以任务内部可以继续派生并等待子任务(fork-join)。
+ */
+
+#ifndef THPOOL_H
+#define THPOOL_H
+
+#include <stddef.h>
+
+/**
+ * @brief 按NUMA节点分配工作线程，并把每个线程绑定到所在节点的一个CPU上，
+ *        窃取时优先选择同一节点的线程
+ */
+#define THPOOL_NUMA 0x1
+
+/**
+ * @brief 线程池
+ */
+typedef struct thpool thpool_t;
+
+/**
+ * @brief 派生出的任务，由 thpool_join 等待并回收
+ */
+typedef struct thpool_task thpool_task_t;
+
+/**
+ * @brief 任务函数类型
+ * @param arg 派生任务时传入的参数
+ */
+typedef void (*thpool_fn_t)(void *arg);
+
+/**
+ * @brief 并行循环的分块函数类型
+ * @param begin 分块的起始下标
+ * @param end 分块的结束下标(不含)
+ * @param arg 传入 thpool_parallel_for 的参数
+ */
+typedef void (*thpool_range_fn_t)(size_t begin, size_t end, void *arg);
+
+/**
+ * @brief 创建线程池
+ * @param nthread 工作线程数，小于等于0时使用在线CPU数
+ * @param flag 选项，可以为 THPOOL_NUMA
+ * @return 新创建的线程池，创建线程失败返回NULL
+ */
+thpool_t *thpool_new(int nthread, int flag);
+
+/**
+ * @brief 等待已派生的任务全部执行完毕，然后停止工作线程并释放线程池
+ * @param pool 线程池
+ */
+void thpool_free(thpool_t *pool);
+
+/**
+ * @brief 工作线程数
+ * @param pool 线程池
+ * @return 工作线程数
+ */
+int thpool_size(thpool_t *pool);
+
+/**
+ * @brief 派生一个任务，可以在任意线程中调用
+ * @param pool 线程池
+ * @param fn 任务函数
+ * @param arg 任务参数，任务完成前需要保持有效
+ * @return 任务句柄，必须调用一次 thpool_join
+ */
+thpool_task_t *thpool_spawn(thpool_t *pool, thpool_fn_t fn, void *arg);
+
+/**
+ * @brief 等待任务完成并回收任务句柄，等待期间执行其他任务
+ * @param pool 线程池
+ * @param task thpool_spawn 返回的任务句柄
+ */
+void thpool_join(thpool_t *pool, thpool_task_t *task);
+
+/**
+ * @brief 并行执行 [begin, end)：区间被递归二分为不超过 grain 的分块，
+ *        各分块可能在不同的线程中执行，全部完成后返回
+ * @param pool 线程池
+ * @param begin 起始下标
+ * @param end 结束下标(不含)
+ * @param grain 分块大小，为0时按工作线程数自动选择
+ * @param fn 分块函数
+ * @param arg 传递给分块函数的参数
+ */
+void thpool_parallel_for(thpool_t *pool, size_t begin, size_t end, size_t grain,
+                         thpool_range_fn_t fn, void *arg);
+
+#endif /* THPOOL_H */
@@ -1,174 +1,2154 @@
 #include "trie.h"
+#include "trie_flat.h"
 #include "hash.h"
 #include "xmalloc.h"
 #include "xstring.h"
-#include "stack.h"
 
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define INVID_PTR(p) (!(p) || (p) == (void *)0x1 || (void *)(p) == (void *)(unsigned long)~0)
 
+/* 子节点容器的类型：大多数节点是叶子或只有一个子节点，
+   只有扇出较大的节点才需要哈希表。 */
+#define TRIE_CHILD_NONE 0
+#define TRIE_CHILD_ONE 1
+#define TRIE_CHILD_SMALL 2
+#define TRIE_CHILD_HASH 3
+
+/* 有序小数组的容量，超过则升级为哈希表，降到一半以下再退回小数组 */
+#define TRIE_SMALL_MAX 8
+
+struct trie_key {
+    const char *str;
+    uint32_t len;
+    uint32_t hash;
+};
+
+/* first[] 存放各子节点 key 的首字节，查找时一次比较全部 8 个 */
+struct trie_small {
+    uint8_t first[TRIE_SMALL_MAX];
+    trie_node_t *nodes[TRIE_SMALL_MAX];
+};
+
+/* 节点状态：由 trie_node_insert 显式插入的节点，
+   radix 模式下不会被合并掉 */
+#define TRIE_STATE_KEY 0x1
+
+/* radix 模式下 key 只是标签的第一段，标签可能由多段以 '/' 连接而成 */
 struct trie_node {
 
     trie_node_t *parent;
-    hash_table_t *childs;
+    struct trie_key key;
+    uint32_t toklen;
+
+    uint8_t flag;
+    uint8_t state;
+    uint8_t kind;
+    uint32_t nchild;
+    /* arena 模式下在 hooks 数组中的下标加一，0 表示不在数组中 */
+    uint32_t hook;
+    union {
+        trie_node_t *one;
+        struct trie_small *small;
+        hash_table_t *hash;
+    } childs;
+
+    /* 参数段(":name")与通配段("*name")子节点，不参与静态子节点的查找 */
+    trie_node_t *param;
+    trie_node_t *wild;
 
-    char *token;
     void *udata;
 
     trie_node_free_fn_t ufree;
 };
 
-trie_node_t *trie_node_new()
+/* arena 模式下节点、token 和小数组都从按块分配的内存中切出，
+   释放的节点和小数组挂在空闲链表上复用，token 直到整棵树删除时才回收 */
+#define TRIE_BLOCK_SIZE (64 * 1024)
+#define TRIE_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+struct trie_block {
+    struct trie_block *next;
+    size_t size;
+};
+
+struct trie_arena {
+    struct trie_block *blocks;
+    char *cur, *end;
+
+    void *free_nodes;
+    void *free_smalls;
+
+    /* 设置了 ufree 或持有哈希表的节点，删除整棵树时只需处理这些节点再释放内存块 */
+    trie_node_t **hooks;
+    uint32_t nhooks, caphooks;
+};
+
+struct trie_root {
+    trie_node_t node;
+    struct trie_arena arena;
+};
+
+static struct trie_arena *trie_arena_of(trie_node_t *node)
 {
-    trie_node_t *node = xnew0(trie_node_t);
+    if (!(node->flag & TRIE_FLAG_ARENA))
+        return NULL;
 
-    node->parent = NULL;
-    node->childs = make_string_hash_table(0);
+    while (node->parent)
+        node = node->parent;
 
-    node->token = NULL;
-    node->udata = NULL;
+    return &((struct trie_root *)node)->arena;
+}
 
-    node->ufree = NULL;
+static void *arena_alloc(struct trie_arena *ar, size_t size)
+{
+    size = TRIE_ALIGN(size);
 
-    return node;
+    if ((size_t)(ar->end - ar->cur) < size) {
+        size_t bsize = size > TRIE_BLOCK_SIZE ? size : TRIE_BLOCK_SIZE;
+        struct trie_block *blk = xmalloc(sizeof(struct trie_block) + bsize);
+
+        blk->next = ar->blocks;
+        blk->size = bsize;
+        ar->blocks = blk;
+        ar->cur = (char *)(blk + 1);
+        ar->end = ar->cur + bsize;
+    }
+
+    void *ptr = ar->cur;
+    ar->cur += size;
+    return ptr;
 }
 
-static void trie_node_free(trie_node_t *node)
+static void *arena_get(struct trie_arena *ar, void **freelist, size_t size)
 {
-    if (node->ufree)
-        node->ufree(node->udata);
+    void *ptr = *freelist;
+
+    if (ptr)
+        *freelist = *(void **)ptr;
+    else
+        ptr = arena_alloc(ar, size);
 
-    hash_table_destroy(node->childs);
-    xfree(node->token);
-    xfree(node);
+    return memset(ptr, 0, size);
 }
 
-trie_node_t *trie_node_insert(trie_node_t *parent, const char *prefix)
+static void arena_put(void **freelist, void *ptr)
+{
+    *(void **)ptr = *freelist;
+    *freelist = ptr;
+}
+
+static trie_node_t *node_alloc(struct trie_arena *ar)
 {
-    int found = 1;
-    for (const char *pos = prefix + 1; !INVID_PTR(pos); pos = strchr(pos, '/') + 1) {
+    return ar ? arena_get(ar, &ar->free_nodes, sizeof(trie_node_t)) : xnew0(trie_node_t);
+}
 
-        char *token = strprefix(pos, "/");
+/* 从 hooks 数组中移除：用最后一个元素填补空位 */
+static void arena_unhook(struct trie_arena *ar, trie_node_t *node)
+{
+    trie_node_t *last = ar->hooks[--ar->nhooks];
 
-        trie_node_t *child = hash_table_get(parent->childs, token);
-        if (child == NULL) {
-            found = 0;
+    ar->hooks[node->hook - 1] = last;
+    last->hook = node->hook;
+    node->hook = 0;
+}
+
+/* 节点设置或清除 ufree、切换哈希表后调用，使 hooks 数组与节点状态一致 */
+static void arena_hook(struct trie_arena *ar, trie_node_t *node)
+{
+    int want = node->ufree != NULL || node->kind == TRIE_CHILD_HASH;
+
+    if (!ar || want == (node->hook != 0))
+        return;
+
+    if (!want) {
+        arena_unhook(ar, node);
+        return;
+    }
+
+    if (ar->nhooks == ar->caphooks) {
+        ar->caphooks = ar->caphooks ? ar->caphooks * 2 : 16;
+        ar->hooks = xrealloc(ar->hooks, ar->caphooks * sizeof(trie_node_t *));
+    }
+    ar->hooks[ar->nhooks++] = node;
+    node->hook = ar->nhooks;
+}
+
+static void node_release(struct trie_arena *ar, trie_node_t *node)
+{
+    if (ar && node->hook)
+        arena_unhook(ar, node);
+
+    if (ar)
+        arena_put(&ar->free_nodes, node);
+    else
+        xfree(node);
+}
+
+static struct trie_small *small_alloc(struct trie_arena *ar)
+{
+    return ar ? arena_get(ar, &ar->free_smalls, sizeof(struct trie_small)) : xnew0(struct trie_small);
+}
+
+static void small_release(struct trie_arena *ar, struct trie_small *sm)
+{
+    if (ar)
+        arena_put(&ar->free_smalls, sm);
+    else
+        xfree(sm);
+}
+
+static char *token_alloc(struct trie_arena *ar, size_t len)
+{
+    return ar ? arena_alloc(ar, len + 1) : xmalloc(len + 1);
+}
+
+static void token_release(struct trie_arena *ar, const char *token)
+{
+    if (!ar)
+        free((char *)token);
+}
+
+static uint32_t trie_hash(const char *str, uint32_t len)
+{
+    uint32_t h = 0;
+
+    for (uint32_t i = 0; i < len; i++)
+        h = (h << 5) - h + (unsigned char)str[i];
+
+    return h;
+}
+
+static unsigned long trie_key_hash(const void *key)
+{
+    return ((const struct trie_key *)key)->hash;
+}
+
+static int trie_key_equal(const void *k1, const void *k2)
+{
+    const struct trie_key *a = k1, *b = k2;
+
+    return a->hash == b->hash && a->len == b->len && !memcmp(a->str, b->str, a->len);
+}
+
+static int trie_key_cmp(const struct trie_key *a, const struct trie_key *b)
+{
+    uint32_t n = a->len < b->len ? a->len : b->len;
+    int res = memcmp(a->str, b->str, n);
+
+    return res ? res : (int)a->len - (int)b->len;
+}
+
+static inline uint8_t trie_key_first(const struct trie_key *key)
+{
+    return key->len ? (uint8_t)key->str[0] : 0;
+}
+
+/* 返回 first[0..n) 中等于 c 的位置掩码 */
+static inline unsigned small_match(const struct trie_small *sm, uint32_t n, uint8_t c)
+{
+#ifdef __SSE2__
+    __m128i v = _mm_loadl_epi64((const __m128i *)sm->first);
+    __m128i k = _mm_set1_epi8((char)c);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, k));
+#else
+    unsigned mask = 0;
+    for (uint32_t i = 0; i < TRIE_SMALL_MAX; i++)
+        mask |= (unsigned)(sm->first[i] == c) << i;
+#endif
+    return mask & ((1u << n) - 1);
+}
+
+static trie_node_t *child_find(const trie_node_t *node, const struct trie_key *key)
+{
+    switch (node->kind) {
+    case TRIE_CHILD_ONE:
+        return trie_key_equal(&node->childs.one->key, key) ? node->childs.one : NULL;
+
+    case TRIE_CHILD_SMALL: {
+        const struct trie_small *sm = node->childs.small;
+        unsigned mask = small_match(sm, node->nchild, trie_key_first(key));
+
+        for (; mask; mask &= mask - 1) {
+            trie_node_t *child = sm->nodes[__builtin_ctz(mask)];
+            if (trie_key_equal(&child->key, key))
+                return child;
+        }
+        return NULL;
+    }
+
+    case TRIE_CHILD_HASH:
+        return hash_table_get(node->childs.hash, key);
+    }
 
-            child = trie_node_new();
-            child->parent = parent;
-            child->token = token;
+    return NULL;
+}
+
+static void small_insert(struct trie_small *sm, uint32_t n, trie_node_t *child)
+{
+    uint32_t i = n;
+
+    while (i > 0 && trie_key_cmp(&sm->nodes[i - 1]->key, &child->key) > 0) {
+        sm->nodes[i] = sm->nodes[i - 1];
+        sm->first[i] = sm->first[i - 1];
+        i--;
+    }
+
+    sm->nodes[i] = child;
+    sm->first[i] = trie_key_first(&child->key);
+}
+
+static void child_add(struct trie_arena *ar, trie_node_t *node, trie_node_t *child)
+{
+    switch (node->kind) {
+    case TRIE_CHILD_NONE:
+        node->kind = TRIE_CHILD_ONE;
+        node->childs.one = child;
+        break;
+
+    case TRIE_CHILD_ONE: {
+        struct trie_small *sm = small_alloc(ar);
+        small_insert(sm, 0, node->childs.one);
+        small_insert(sm, 1, child);
+        node->kind = TRIE_CHILD_SMALL;
+        node->childs.small = sm;
+        break;
+    }
 
-            hash_table_put(parent->childs, token, child);
+    case TRIE_CHILD_SMALL:
+        if (node->nchild < TRIE_SMALL_MAX) {
+            small_insert(node->childs.small, node->nchild, child);
         } else {
-            xfree(token);
+            struct trie_small *sm = node->childs.small;
+            hash_table_t *ht = hash_table_new(TRIE_SMALL_MAX * 2, trie_key_hash, trie_key_equal);
+
+            for (uint32_t i = 0; i < node->nchild; i++)
+                hash_table_put(ht, &sm->nodes[i]->key, sm->nodes[i]);
+            hash_table_put(ht, &child->key, child);
+
+            small_release(ar, sm);
+            node->kind = TRIE_CHILD_HASH;
+            node->childs.hash = ht;
+            arena_hook(ar, node);
         }
+        break;
 
-        parent = child;
+    case TRIE_CHILD_HASH:
+        hash_table_put(node->childs.hash, &child->key, child);
+        break;
     }
 
-    return found ? NULL : parent;
+    node->nchild++;
 }
 
-trie_node_t *trie_node_search(trie_node_t *parent, const char *prefix)
+static void child_del(struct trie_arena *ar, trie_node_t *node, trie_node_t *child)
+{
+    switch (node->kind) {
+    case TRIE_CHILD_ONE:
+        node->kind = TRIE_CHILD_NONE;
+        node->childs.one = NULL;
+        break;
+
+    case TRIE_CHILD_SMALL: {
+        struct trie_small *sm = node->childs.small;
+        uint32_t i = 0;
+
+        while (sm->nodes[i] != child)
+            i++;
+        for (; i + 1 < node->nchild; i++) {
+            sm->nodes[i] = sm->nodes[i + 1];
+            sm->first[i] = sm->first[i + 1];
+        }
+
+        if (node->nchild == 2) {
+            node->kind = TRIE_CHILD_ONE;
+            node->childs.one = sm->nodes[0];
+            small_release(ar, sm);
+        }
+        break;
+    }
+
+    case TRIE_CHILD_HASH:
+        hash_table_remove(node->childs.hash, &child->key);
+
+        if (node->nchild - 1 <= TRIE_SMALL_MAX / 2) {
+            hash_table_t *ht = node->childs.hash;
+            struct trie_small *sm = small_alloc(ar);
+            uint32_t n = 0;
+
+            hash_table_foreach(ht, it)
+                small_insert(sm, n++, it.val);
+
+            hash_table_destroy(ht);
+            node->kind = TRIE_CHILD_SMALL;
+            node->childs.small = sm;
+            arena_hook(ar, node);
+        }
+        break;
+    }
+
+    node->nchild--;
+}
+
+static void child_free(struct trie_arena *ar, trie_node_t *node)
+{
+    if (node->kind == TRIE_CHILD_SMALL) {
+        small_release(ar, node->childs.small);
+    } else if (node->kind == TRIE_CHILD_HASH) {
+        hash_table_destroy(node->childs.hash);
+    }
+
+    node->kind = TRIE_CHILD_NONE;
+    node->nchild = 0;
+    arena_hook(ar, node);
+}
+
+/* 子节点迭代器，先静态子节点，再参数和通配子节点，遍历期间不能增删子节点 */
+typedef struct {
+    const trie_node_t *node;
+    uint32_t cur;
+    int phase;
+    ht_iter_t it;
+} child_iter_t;
+
+static void child_iter_init(child_iter_t *ci, const trie_node_t *node)
+{
+    ci->node = node;
+    ci->cur = 0;
+    ci->phase = 0;
+    if (node->kind == TRIE_CHILD_HASH)
+        ci->it = hash_table_first(node->childs.hash);
+}
+
+static trie_node_t *child_iter_next(child_iter_t *ci)
 {
+    const trie_node_t *node = ci->node;
     trie_node_t *child = NULL;
 
-    for (const char *pos = prefix + 1; !INVID_PTR(pos); pos = strchr(pos, '/') + 1) {
-        char *token = strprefix(pos, "/");
+    if (ci->phase == 1) {
+        ci->phase = 2;
+        if (node->param)
+            return node->param;
+    }
+    if (ci->phase == 2) {
+        ci->phase = 3;
+        return node->wild;
+    }
+    if (ci->phase == 3)
+        return NULL;
 
-        child = hash_table_get(parent->childs, token);
-        if (child == NULL) {
-            xfree(token);
-            break;
+    switch (node->kind) {
+    case TRIE_CHILD_ONE:
+        if (ci->cur++ == 0)
+            child = node->childs.one;
+        break;
+
+    case TRIE_CHILD_SMALL:
+        if (ci->cur < node->nchild)
+            child = node->childs.small->nodes[ci->cur++];
+        break;
+
+    case TRIE_CHILD_HASH:
+        if (!hash_table_end(ci->it)) {
+            child = ci->it.val;
+            ci->it = hash_table_next(ci->it);
         }
+        break;
+    }
 
-        parent = child;
-        xfree(token);
+    if (child == NULL) {
+        ci->phase = 1;
+        return child_iter_next(ci);
     }
 
     return child;
 }
 
-bool trie_node_isleaf(trie_node_t *node)
+static inline bool trie_is_pattern(const char *seg)
 {
-    return hash_table_count(node->childs) == 0;
+    return seg[0] == ':' || seg[0] == '*';
 }
 
-void trie_node_remove(trie_node_t *node, const char *prefix)
+/* 从父节点中摘除 child */
+static void trie_node_unlink(struct trie_arena *ar, trie_node_t *child)
 {
-    node = trie_node_search(node, prefix);
-    if (!node)
-        return;
+    trie_node_t *parent = child->parent;
+
+    if (parent->param == child)
+        parent->param = NULL;
+    else if (parent->wild == child)
+        parent->wild = NULL;
+    else
+        child_del(ar, parent, child);
+}
+
+static void child_replace(trie_node_t *node, trie_node_t *old, trie_node_t *child)
+{
+    switch (node->kind) {
+    case TRIE_CHILD_ONE:
+        node->childs.one = child;
+        break;
+
+    case TRIE_CHILD_SMALL: {
+        struct trie_small *sm = node->childs.small;
+        uint32_t i = 0;
+
+        while (sm->nodes[i] != old)
+            i++;
+        sm->nodes[i] = child;
+        break;
+    }
+
+    case TRIE_CHILD_HASH:
+        hash_table_remove(node->childs.hash, &old->key);
+        hash_table_put(node->childs.hash, &child->key, child);
+        break;
+    }
+}
+
+static void trie_node_init(trie_node_t *node, int flag)
+{
+    node->parent = NULL;
+    node->flag = (uint8_t)flag;
+    node->state = 0;
+    node->kind = TRIE_CHILD_NONE;
+    node->nchild = 0;
+    node->hook = 0;
+
+    node->key.str = NULL;
+    node->udata = NULL;
+
+    node->ufree = NULL;
+}
+
+trie_node_t *trie_node_create(int flag)
+{
+    trie_node_t *node;
+
+    if (flag & TRIE_FLAG_ARENA)
+        node = &xnew0(struct trie_root)->node;
+    else
+        node = xnew0(trie_node_t);
+
+    trie_node_init(node, flag);
+
+    return node;
+}
+
+trie_node_t *trie_node_new()
+{
+    return trie_node_create(0);
+}
+
+static void trie_node_free(struct trie_arena *ar, trie_node_t *node)
+{
+    if (node->ufree) {
+        node->ufree(node->udata);
+        node->ufree = NULL;
+    }
+
+    child_free(ar, node);
+    token_release(ar, node->key.str);
+    node_release(ar, node);
+}
 
-    stack_t *sk = stack_new();
-    stack_push(sk, node);
+static void trie_key_segment(struct trie_key *key, const char *pos)
+{
+    const char *end = strchr(pos, '/');
 
-    while (!stack_empty(sk)) {
-        trie_node_t *top = stack_top(sk);
+    key->str = pos;
+    key->len = end ? (uint32_t)(end - pos) : (uint32_t)strlen(pos);
+    key->hash = trie_hash(pos, key->len);
+}
 
-        hash_table_foreach(top->childs, it)
-            stack_push(sk, it.val);
+void trie_path_init(trie_path_t *tp)
+{
+    tp->str = NULL;
+    tp->len = 0;
+    tp->nseg = 0;
+    tp->cap = TRIE_PATH_INLINE;
+    tp->segs = tp->inline_segs;
+}
 
-        top = stack_top(sk);
-        while (top && trie_node_isleaf(top)) {
+void trie_path_free(trie_path_t *tp)
+{
+    if (tp->segs != tp->inline_segs)
+        xfree(tp->segs);
+    trie_path_init(tp);
+}
 
-            hash_table_remove(top->parent->childs, top->token);
-            trie_node_free(top);
+static void trie_path_push(trie_path_t *tp, uint32_t off, uint32_t len)
+{
+    trie_seg_t *seg;
 
-            top = stack_pop(sk);
-            top = stack_top(sk);
+    if (tp->nseg == tp->cap) {
+        tp->cap *= 2;
+        if (tp->segs == tp->inline_segs) {
+            tp->segs = xnew_array(trie_seg_t, tp->cap);
+            memcpy(tp->segs, tp->inline_segs, sizeof(tp->inline_segs));
+        } else {
+            tp->segs = xrealloc(tp->segs, tp->cap * sizeof(trie_seg_t));
         }
     }
 
-    stack_free(sk);
+    seg = &tp->segs[tp->nseg++];
+    seg->off = off;
+    seg->len = len;
+    seg->hash = trie_hash(tp->str + off, len);
 }
 
-void trie_node_delete(trie_node_t *node)
+/* 从 start 开始切分 tp->str 的剩余部分。每次比较 16 字节得到分隔符的位掩码，
+   再逐位取出各段的边界，不再对每段调用 strchr。耗时主要在逐字节计算的段哈希上，
+   整体与逐段 strchr 的做法相当 */
+static void trie_path_scan(trie_path_t *tp, uint32_t start)
 {
-    char prefix[128];
-    hash_table_foreach(node->childs, it)
-    {
-        prefix[0] = '/';
-        prefix[1] = '\0';
-        strcat(prefix, it.key);
+    const char *str = tp->str;
+    uint32_t len = tp->len;
+    uint32_t i = start;
 
-        trie_node_remove(node, prefix);
+#ifdef __SSE2__
+    const __m128i sep = _mm_set1_epi8('/');
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sep));
+
+        for (; mask; mask &= mask - 1) {
+            uint32_t end = i + (uint32_t)__builtin_ctz(mask);
+
+            trie_path_push(tp, start, end - start);
+            start = end + 1;
+        }
     }
+#endif
 
-    trie_node_free(node);
+    for (; i < len; i++) {
+        if (str[i] == '/') {
+            trie_path_push(tp, start, i - start);
+            start = i + 1;
+        }
+    }
+
+    trie_path_push(tp, start, len - start);
 }
 
-void trie_node_foreach(trie_node_t *node, trie_node_visit_fn_t fun, void *arg)
+void trie_path_parse(trie_path_t *tp, const char *path)
 {
-    stack_t *sk = stack_new();
-    stack_push(sk, node);
+    tp->str = path + 1;
+    tp->len = (uint32_t)strlen(tp->str);
+    tp->nseg = 0;
+    trie_path_scan(tp, 0);
+}
 
-    while (!stack_empty(sk)) {
-        trie_node_t *top = stack_pop(sk);
-        if (top->parent && fun(top, arg) == TRIE_NODE_TAKEN)
-            break;
+static inline void trie_path_key(const trie_path_t *tp, uint32_t i, struct trie_key *key)
+{
+    key->str = tp->str + tp->segs[i].off;
+    key->len = tp->segs[i].len;
+    key->hash = tp->segs[i].hash;
+}
+
+/* 第 i 段开始的剩余路径长度 */
+static inline uint32_t trie_path_rem(const trie_path_t *tp, uint32_t i)
+{
+    return tp->len - tp->segs[i].off;
+}
+
+/* 跳过从第 i 段开始、长度为 b 的标签，返回其后第一段的下标 */
+static inline uint32_t trie_path_skip(const trie_path_t *tp, uint32_t i, uint32_t b)
+{
+    uint32_t end = tp->segs[i].off + b;
+
+    while (i < tp->nseg && tp->segs[i].off <= end)
+        i++;
+
+    return i;
+}
+
+static trie_node_t *trie_node_child(struct trie_arena *ar, trie_node_t *parent,
+                                   const char *label, uint32_t len)
+{
+    trie_node_t *child = node_alloc(ar);
+    char *token = token_alloc(ar, len);
+
+    memcpy(token, label, len);
+    token[len] = '\0';
+
+    trie_node_init(child, parent->flag);
+    child->parent = parent;
+    child->key.str = token;
+    child->toklen = len;
+    trie_key_segment(&child->key, child->key.str);
 
-        hash_table_foreach(top->childs, it)
-            stack_push(sk, it.val);
+    return child;
+}
+
+/* 在段边界上比较标签与剩余路径，返回共同的前缀长度。
+   两者同时结束或在此处都是 '/' 才算边界。 */
+static uint32_t radix_common(const trie_node_t *node, const char *rem, uint32_t remlen)
+{
+    const char *label = node->key.str;
+    uint32_t len = node->toklen;
+    uint32_t i = 0, b = 0;
+
+    while (i < len && i < remlen && label[i] == rem[i]) {
+        if (label[i] == '/')
+            b = i;
+        i++;
     }
 
-    stack_free(sk);
+    if ((i == len || label[i] == '/') && (i == remlen || rem[i] == '/'))
+        return i;
+
+    return b;
 }
 
-void trie_node_set_data(trie_node_t *node, void *data, trie_node_free_fn_t fun)
+/* 把 node 的标签在 b 处一分为二，前半部分成为新的父节点 */
+static trie_node_t *radix_split(struct trie_arena *ar, trie_node_t *node, uint32_t b)
 {
-    node->udata = data;
-    node->ufree = fun;
+    trie_node_t *parent = node->parent;
+    trie_node_t *mid = trie_node_child(ar, parent, node->key.str, b);
+    uint32_t len = node->toklen - b - 1;
+    char *label = token_alloc(ar, len);
+
+    memcpy(label, node->key.str + b + 1, len + 1);
+    child_replace(parent, node, mid);
+
+    token_release(ar, node->key.str);
+    node->key.str = label;
+    node->toklen = len;
+    trie_key_segment(&node->key, label);
+    node->parent = mid;
+    child_add(ar, mid, node);
+
+    return mid;
 }
 
-void *trie_node_get_data(trie_node_t *node)
+/* 从第 i 段开始的标签在第一个参数或通配段之前结束 */
+static uint32_t radix_static_len(const trie_path_t *tp, uint32_t i)
 {
-    return node->udata;
+    for (uint32_t j = i + 1; j < tp->nseg; j++) {
+        if (trie_is_pattern(tp->str + tp->segs[j].off))
+            return tp->segs[j].off - 1 - tp->segs[i].off;
+    }
+
+    return trie_path_rem(tp, i);
 }
 
-const char *trie_node_get_token(trie_node_t *node)
+/* 把无数据的 node 与它唯一的子节点合并，保留子节点 */
+static void radix_merge(struct trie_arena *ar, trie_node_t *node)
+{
+    trie_node_t *child = node->childs.one;
+    uint32_t len = node->toklen + 1 + child->toklen;
+    char *label = token_alloc(ar, len);
+
+    memcpy(label, node->key.str, node->toklen);
+    label[node->toklen] = '/';
+    memcpy(label + node->toklen + 1, child->key.str, child->toklen + 1);
+
+    token_release(ar, child->key.str);
+    child->key = node->key;
+    child->key.str = label;
+    child->toklen = len;
+
+    child_replace(node->parent, node, child);
+    child->parent = node->parent;
+
+    token_release(ar, node->key.str);
+    child_free(ar, node);
+    node_release(ar, node);
+}
+
+/* 返回参数段或通配段对应的子节点槽位 */
+static trie_node_t **trie_node_slot(trie_node_t *node, const char *seg)
 {
-    return node->token;
+    return seg[0] == ':' ? &node->param : &node->wild;
+}
+
+static trie_node_t *radix_insert(struct trie_arena *ar, trie_node_t *node, const trie_path_t *tp)
+{
+    trie_node_t *child;
+    uint32_t i = 0;
+
+    for (;;) {
+        struct trie_key key;
+        trie_path_key(tp, i, &key);
+
+        const char *rem = key.str;
+        uint32_t remlen = trie_path_rem(tp, i);
+
+        if (node->key.str && node->key.str[0] == '*')
+            return NULL;
+
+        if (trie_is_pattern(rem)) {
+            trie_node_t **slot = trie_node_slot(node, rem);
+
+            if (*slot == NULL)
+                *slot = trie_node_child(ar, node, rem, key.len);
+
+            child = *slot;
+            if (key.len == remlen)
+                return child;
+
+            node = child;
+            i++;
+            continue;
+        }
+
+        child = child_find(node, &key);
+        if (child == NULL) {
+            uint32_t len = radix_static_len(tp, i);
+
+            child = trie_node_child(ar, node, rem, len);
+            child_add(ar, node, child);
+            if (len == remlen)
+                return child;
+
+            node = child;
+            i = trie_path_skip(tp, i, len);
+            continue;
+        }
+
+        uint32_t b = radix_common(child, rem, remlen);
+        if (b == child->toklen) {
+            if (b == remlen)
+                return child;
+            node = child;
+        } else {
+            node = radix_split(ar, child, b);
+            if (b == remlen)
+                return node;
+        }
+
+        i = trie_path_skip(tp, i, b);
+    }
+}
+
+/* partial 为真时，允许路径在某个标签内部的段边界处结束 */
+static trie_node_t *radix_search(trie_node_t *node, const trie_path_t *tp, int partial)
+{
+    uint32_t i = 0;
+
+    for (;;) {
+        struct trie_key key;
+        trie_path_key(tp, i, &key);
+
+        const char *rem = key.str;
+        uint32_t remlen = trie_path_rem(tp, i);
+
+        if (trie_is_pattern(rem)) {
+            trie_node_t *child = *trie_node_slot(node, rem);
+            if (child == NULL || key.len == remlen)
+                return child;
+
+            node = child;
+            i++;
+            continue;
+        }
+
+        trie_node_t *child = child_find(node, &key);
+        if (child == NULL)
+            return NULL;
+
+        uint32_t b = radix_common(child, rem, remlen);
+        if (b == remlen)
+            return b == child->toklen || partial ? child : NULL;
+        if (b != child->toklen)
+            return NULL;
+
+        node = child;
+        i = trie_path_skip(tp, i, b);
+    }
+}
+
+/* 沿路径找到或创建末端节点，两种模式都只在它已被显式插入过时返回 NULL。
+   通配段后还有其他段的路径在修改树之前就被拒绝 */
+static trie_node_t *trie_insert(struct trie_arena *ar, trie_node_t *parent, const trie_path_t *tp)
+{
+    trie_node_t *node = parent;
+
+    for (uint32_t i = 0; i + 1 < tp->nseg; i++) {
+        if (tp->str[tp->segs[i].off] == '*')
+            return NULL;
+    }
+
+    if (parent->flag & TRIE_FLAG_RADIX) {
+        node = radix_insert(ar, parent, tp);
+    } else {
+        for (uint32_t i = 0; i < tp->nseg; i++) {
+            struct trie_key key;
+            trie_path_key(tp, i, &key);
+
+            if (node->key.str && node->key.str[0] == '*')
+                return NULL;
+
+            trie_node_t *child;
+            if (trie_is_pattern(key.str)) {
+                trie_node_t **slot = trie_node_slot(node, key.str);
+                if (*slot == NULL)
+                    *slot = trie_node_child(ar, node, key.str, key.len);
+                child = *slot;
+            } else if ((child = child_find(node, &key)) == NULL) {
+                child = trie_node_child(ar, node, key.str, key.len);
+                child_add(ar, node, child);
+            }
+
+            node = child;
+        }
+    }
+
+    if (node == NULL || (node->state & TRIE_STATE_KEY))
+        return NULL;
+
+    node->state |= TRIE_STATE_KEY;
+    return node;
+}
+
+static trie_node_t *trie_search(trie_node_t *parent, const trie_path_t *tp, int partial)
+{
+    if (parent->flag & TRIE_FLAG_RADIX)
+        return radix_search(parent, tp, partial);
+
+    trie_node_t *child = NULL;
+
+    for (uint32_t i = 0; i < tp->nseg; i++) {
+        struct trie_key key;
+        trie_path_key(tp, i, &key);
+
+        if (trie_is_pattern(key.str))
+            child = *trie_node_slot(parent, key.str);
+        else
+            child = child_find(parent, &key);
+        if (child == NULL)
+            break;
+
+        parent = child;
+    }
+
+    return child;
+}
+
+trie_node_t *trie_node_insert(trie_node_t *parent, const char *prefix)
+{
+    trie_path_t tp;
+    trie_node_t *node;
+
+    trie_path_init(&tp);
+    trie_path_parse(&tp, prefix);
+    node = trie_insert(trie_arena_of(parent), parent, &tp);
+    trie_path_free(&tp);
+
+    return node;
+}
+
+trie_node_t *trie_node_search(trie_node_t *parent, const char *prefix)
+{
+    trie_path_t tp;
+    trie_node_t *node;
+
+    trie_path_init(&tp);
+    trie_path_parse(&tp, prefix);
+    node = trie_search(parent, &tp, 0);
+    trie_path_free(&tp);
+
+    return node;
+}
+
+trie_node_t *trie_node_search_path(trie_node_t *parent, const trie_path_t *tp)
+{
+    return trie_search(parent, tp, 0);
+}
+
+/* 批量查找时记录上一条路径走过的节点：node 匹配了路径的前 end - 1 个字节，
+   下一段从 end 开始，根节点的 end 为 0 */
+struct trie_batch_frame {
+    trie_node_t *node;
+    uint32_t end;
+};
+
+struct trie_batch {
+    trie_node_t *root;
+    const char *const *paths;
+    const char *const **order; /* 排序后的查找顺序，指向 paths 中的元素 */
+    trie_node_t **out;
+    size_t begin, end;
+
+    trie_path_t tp;
+    const char *prev;
+    trie_node_t *prev_node;
+    struct trie_batch_frame *frames;
+    uint32_t depth, cap;
+};
+
+/* 批量查找的线程数按每线程至少这么多条路径计算 */
+#define TRIE_BATCH_CHUNK 4096
+
+static void trie_batch_push(struct trie_batch *b, trie_node_t *node, uint32_t end)
+{
+    if (b->depth == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 16;
+        b->frames = xrealloc(b->frames, b->cap * sizeof(struct trie_batch_frame));
+    }
+
+    b->frames[b->depth].node = node;
+    b->frames[b->depth].end = end;
+    b->depth++;
+}
+
+/* 与 trie_search(partial 为 0) 相同，但从第 i 段和 node 开始，并记录经过的节点 */
+static trie_node_t *trie_batch_walk(struct trie_batch *b, trie_node_t *node, uint32_t i)
+{
+    const trie_path_t *tp = &b->tp;
+    int radix = node->flag & TRIE_FLAG_RADIX;
+
+    for (;;) {
+        struct trie_key key;
+        trie_node_t *child;
+        uint32_t remlen = trie_path_rem(tp, i);
+        uint32_t len;
+
+        trie_path_key(tp, i, &key);
+        if (trie_is_pattern(key.str)) {
+            child = *trie_node_slot(node, key.str);
+            len = key.len;
+        } else {
+            child = child_find(node, &key);
+            len = key.len;
+            if (child && radix && (len = radix_common(child, key.str, remlen)) != child->toklen)
+                return NULL;
+        }
+        if (child == NULL)
+            return NULL;
+
+        trie_batch_push(b, child, tp->segs[i].off + len + 1);
+        if (len == remlen)
+            return child;
+
+        node = child;
+        i = radix ? trie_path_skip(tp, i, len) : i + 1;
+    }
+}
+
+static trie_node_t *trie_batch_search(struct trie_batch *b, const char *path)
+{
+    const char *cur = path + 1;
+    uint32_t l = 0, i = 0, end;
+
+    if (b->prev) {
+        const char *prev = b->prev + 1;
+
+        while (cur[l] && cur[l] == prev[l])
+            l++;
+        if (cur[l] == '\0' && prev[l] == '\0')
+            return b->prev_node;
+        /* 上一条路径是当前路径的前缀，它的结尾相当于一个'/' */
+        if (prev[l] == '\0' && cur[l] == '/')
+            l++;
+    }
+
+    /* 保留匹配部分完全落在公共前缀内的节点 */
+    while (b->depth > 1 && b->frames[b->depth - 1].end > l)
+        b->depth--;
+    end = b->frames[b->depth - 1].end;
+
+    /* 公共前缀内的段与上一条路径相同，只切分其后的部分 */
+    while (i < b->tp.nseg && b->tp.segs[i].off < end)
+        i++;
+    b->tp.str = cur;
+    b->tp.len = l + (uint32_t)strlen(cur + l);
+    b->tp.nseg = i;
+    trie_path_scan(&b->tp, end);
+
+    b->prev = path;
+    b->prev_node = trie_batch_walk(b, b->frames[b->depth - 1].node, i);
+    return b->prev_node;
+}
+
+static void *trie_batch_run(void *arg)
+{
+    struct trie_batch *b = arg;
+
+    trie_path_init(&b->tp);
+    b->depth = 0;
+    trie_batch_push(b, b->root, 0);
+
+    for (size_t k = b->begin; k < b->end; k++) {
+        const char *const *p = b->order ? b->order[k] : &b->paths[k];
+
+        b->out[p - b->paths] = trie_batch_search(b, *p);
+    }
+
+    trie_path_free(&b->tp);
+    xfree(b->frames);
+    return NULL;
+}
+
+static int trie_batch_cmp(const void *a, const void *b)
+{
+    return strcmp(**(const char *const *const *)a, **(const char *const *const *)b);
+}
+
+/* 把 [0, n) 均分给 nthread 个线程查找，order 非空时按 order 的顺序 */
+static void trie_batch_split(trie_node_t *parent, const char *const *paths, const char *const **order,
+                             size_t n, trie_node_t **out, size_t nthread)
+{
+    struct trie_batch *batch = xnew0_array(struct trie_batch, nthread);
+    pthread_t *tids = xnew_array(pthread_t, nthread);
+
+    for (size_t t = 0; t < nthread; t++) {
+        batch[t].root = parent;
+        batch[t].paths = paths;
+        batch[t].order = order;
+        batch[t].out = out;
+        batch[t].begin = n * t / nthread;
+        batch[t].end = n * (t + 1) / nthread;
+    }
+
+    /* 第 0 段在当前线程执行，线程创建失败的段也退回当前线程 */
+    for (size_t t = 1; t < nthread; t++) {
+        if (pthread_create(&tids[t], NULL, trie_batch_run, &batch[t]) != 0) {
+            trie_batch_run(&batch[t]);
+            batch[t].root = NULL;
+        }
+    }
+    trie_batch_run(&batch[0]);
+    for (size_t t = 1; t < nthread; t++) {
+        if (batch[t].root)
+            pthread_join(tids[t], NULL);
+    }
+
+    xfree(tids);
+    xfree(batch);
+}
+
+void trie_node_search_batch(trie_node_t *parent, const char *const *paths, size_t n,
+                            trie_node_t **out, int flag)
+{
+    const char *const **order = NULL;
+    size_t nthread = 1;
+
+    if (n == 0)
+        return;
+
+    if (flag & TRIE_BATCH_SORT) {
+        order = xnew_array(const char *const *, n);
+        for (size_t k = 0; k < n; k++)
+            order[k] = &paths[k];
+        qsort(order, n, sizeof(*order), trie_batch_cmp);
+    }
+
+    if (flag & TRIE_BATCH_PARALLEL) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthread = n / TRIE_BATCH_CHUNK;
+        if (ncpu > 0 && nthread > (size_t)ncpu)
+            nthread = (size_t)ncpu;
+        if (nthread == 0)
+            nthread = 1;
+    }
+
+    trie_batch_split(parent, paths, order, n, out, nthread);
+    xfree(order);
+}
+
+trie_node_t *trie_node_longest_prefix(trie_node_t *parent, const char *prefix, size_t *matched_len)
+{
+    trie_node_t *best = NULL;
+    trie_path_t tp;
+    uint32_t i = 0;
+
+    *matched_len = 0;
+    trie_path_init(&tp);
+    trie_path_parse(&tp, prefix);
+
+    for (;;) {
+        struct trie_key key;
+        trie_node_t *child;
+        uint32_t remlen = trie_path_rem(&tp, i);
+        uint32_t b;
+
+        trie_path_key(&tp, i, &key);
+        if (trie_is_pattern(key.str)) {
+            child = *trie_node_slot(parent, key.str);
+            if (child == NULL)
+                break;
+            b = key.len;
+        } else {
+            child = child_find(parent, &key);
+            if (child == NULL || (b = radix_common(child, key.str, remlen)) != child->toklen)
+                break;
+        }
+
+        if (child->udata) {
+            best = child;
+            *matched_len = (size_t)(key.str + b - prefix);
+        }
+        if (b == remlen)
+            break;
+
+        parent = child;
+        i = trie_path_skip(&tp, i, b);
+    }
+
+    trie_path_free(&tp);
+    return best;
+}
+
+bool trie_node_isleaf(trie_node_t *node)
+{
+    return node->nchild == 0 && !node->param && !node->wild;
+}
+
+/* 后序遍历用的栈帧，栈是一块连续内存，开始时在调用者的栈上 */
+#define TRIE_WALK_INLINE 32
+
+typedef void (*trie_walk_fn_t)(struct trie_arena *ar, trie_node_t *node);
+
+/* 一次后序遍历 node 的子树，每个节点只访问一次，
+   fn 在节点的所有子节点都处理完后调用，可以释放该节点 */
+static void trie_walk_post(struct trie_arena *ar, trie_node_t *node, trie_walk_fn_t fn)
+{
+    child_iter_t inline_frames[TRIE_WALK_INLINE];
+    child_iter_t *frames = inline_frames;
+    size_t cap = TRIE_WALK_INLINE, depth = 0;
+
+    child_iter_init(&frames[depth++], node);
+
+    while (depth > 0) {
+        child_iter_t *top = &frames[depth - 1];
+        trie_node_t *child = child_iter_next(top);
+
+        if (child == NULL) {
+            fn(ar, (trie_node_t *)top->node);
+            depth--;
+            continue;
+        }
+
+        if (trie_node_isleaf(child)) {
+            fn(ar, child);
+            continue;
+        }
+
+        if (depth == cap) {
+            cap *= 2;
+            if (frames == inline_frames) {
+                frames = xnew_array(child_iter_t, cap);
+                memcpy(frames, inline_frames, sizeof(inline_frames));
+            } else {
+                frames = xrealloc(frames, cap * sizeof(child_iter_t));
+            }
+        }
+        child_iter_init(&frames[depth++], child);
+    }
+
+    if (frames != inline_frames)
+        xfree(frames);
+}
+
+void trie_node_remove(trie_node_t *node, const char *prefix)
+{
+    trie_path_t tp;
+
+    trie_path_init(&tp);
+    trie_path_parse(&tp, prefix);
+    node = trie_search(node, &tp, 1);
+    trie_path_free(&tp);
+    if (!node)
+        return;
+
+    trie_node_t *parent = node->parent;
+    struct trie_arena *ar = trie_arena_of(parent);
+
+    trie_node_unlink(ar, node);
+    trie_walk_post(ar, node, trie_node_free);
+
+    if (!(parent->flag & TRIE_FLAG_RADIX))
+        return;
+
+    /* 重新合并因删除而只剩单个子节点的无数据节点 */
+    while (parent->parent && !(parent->state & TRIE_STATE_KEY) && !parent->udata) {
+        trie_node_t *up = parent->parent;
+
+        if (parent->param || parent->wild)
+            break;
+        if (parent->nchild == 1 && !trie_is_pattern(parent->key.str)) {
+            radix_merge(ar, parent);
+            break;
+        }
+        if (parent->nchild != 0)
+            break;
+
+        trie_node_unlink(ar, parent);
+        trie_node_free(ar, parent);
+        parent = up;
+    }
+}
+
+static void trie_node_unhook(trie_node_t *node)
+{
+    if (node->ufree)
+        node->ufree(node->udata);
+    if (node->kind == TRIE_CHILD_HASH)
+        hash_table_destroy(node->childs.hash);
+}
+
+/* 删除 arena 模式的整棵树：只处理 hooks 数组中的节点，其余内存随内存块一起释放 */
+static void trie_arena_destroy(trie_node_t *root)
+{
+    struct trie_arena *ar = &((struct trie_root *)root)->arena;
+
+    for (uint32_t i = 0; i < ar->nhooks; i++)
+        trie_node_unhook(ar->hooks[i]);
+    xfree(ar->hooks);
+
+    while (ar->blocks) {
+        struct trie_block *blk = ar->blocks;
+        ar->blocks = blk->next;
+        xfree(blk);
+    }
+
+    xfree(root);
+}
+
+void trie_node_delete(trie_node_t *node)
+{
+    if ((node->flag & TRIE_FLAG_ARENA) && node->parent == NULL)
+        trie_arena_destroy(node);
+    else
+        trie_walk_post(trie_arena_of(node), node, trie_node_free);
+}
+
+struct trie_iter_frame {
+    child_iter_t ci;
+    size_t base; /* 该节点完整路径的长度 */
+};
+
+void trie_iter_init(trie_iter_t *it)
+{
+    memset(it, 0, sizeof(*it));
+}
+
+void trie_iter_free(trie_iter_t *it)
+{
+    xfree(it->frames);
+    xfree(it->path);
+    it->cap = it->pathcap = 0;
+}
+
+static void trie_iter_push(trie_iter_t *it, trie_node_t *node)
+{
+    struct trie_iter_frame *frames = it->frames;
+
+    if (it->depth == it->cap) {
+        it->cap = it->cap ? it->cap * 2 : 16;
+        frames = it->frames = xrealloc(it->frames, it->cap * sizeof(struct trie_iter_frame));
+    }
+
+    child_iter_init(&frames[it->depth].ci, node);
+    frames[it->depth].base = it->pathlen;
+    it->depth++;
+}
+
+/* 路径截断到 base 后追加 "/" 和节点的标签 */
+static void trie_iter_path_append(trie_iter_t *it, size_t base, const trie_node_t *node)
+{
+    size_t need = base + 1 + node->toklen + 1;
+
+    if (need > it->pathcap) {
+        while (need > it->pathcap)
+            it->pathcap = it->pathcap ? it->pathcap * 2 : 256;
+        it->path = xrealloc(it->path, it->pathcap);
+    }
+
+    it->path[base] = '/';
+    memcpy(it->path + base + 1, node->key.str, node->toklen + 1);
+    it->pathlen = base + 1 + node->toklen;
+}
+
+void trie_iter_begin(trie_iter_t *it, trie_node_t *node, int order)
+{
+    it->depth = 0;
+    it->pathlen = 0;
+    it->pending = NULL;
+    it->order = order;
+    it->skip = 0;
+    it->post = 0;
+    it->level = 0;
+
+    if (it->pathcap == 0) {
+        it->pathcap = 256;
+        it->path = xmalloc(it->pathcap);
+    }
+    it->path[0] = '\0';
+
+    trie_iter_push(it, node);
+}
+
+trie_node_t *trie_iter_next(trie_iter_t *it)
+{
+    for (;;) {
+        trie_node_t *node = it->pending;
+
+        /* 上一次返回的节点：进入它的子节点，或者已被剪枝/是叶子时直接结束它 */
+        if (node) {
+            it->pending = NULL;
+
+            if (!it->skip && !trie_node_isleaf(node)) {
+                trie_iter_push(it, node);
+            } else if (it->order & TRIE_ITER_POST) {
+                it->skip = 0;
+                it->post = 1;
+                it->level = it->depth;
+                return node;
+            }
+            it->skip = 0;
+        }
+
+        if (it->depth == 0)
+            return NULL;
+
+        struct trie_iter_frame *top = (struct trie_iter_frame *)it->frames + it->depth - 1;
+        trie_node_t *child = child_iter_next(&top->ci);
+
+        if (child == NULL) {
+            it->depth--;
+            if (it->depth == 0)
+                return NULL;
+
+            if (it->order & TRIE_ITER_POST) {
+                it->pathlen = top->base;
+                it->path[it->pathlen] = '\0';
+                it->post = 1;
+                it->level = it->depth;
+                return (trie_node_t *)top->ci.node;
+            }
+            continue;
+        }
+
+        trie_iter_path_append(it, top->base, child);
+        it->pending = child;
+
+        if (it->order & TRIE_ITER_PRE) {
+            it->post = 0;
+            it->level = it->depth;
+            return child;
+        }
+    }
+}
+
+void trie_iter_skip(trie_iter_t *it)
+{
+    it->skip = 1;
+}
+
+void trie_node_foreach(trie_node_t *node, trie_node_visit_fn_t fun, void *arg)
+{
+    trie_iter_t it;
+    trie_node_t *cur;
+
+    if (node->parent && fun(node, arg) == TRIE_NODE_TAKEN)
+        return;
+
+    trie_iter_init(&it);
+    trie_iter_begin(&it, node, TRIE_ITER_PRE);
+
+    while ((cur = trie_iter_next(&it)) != NULL) {
+        if (fun(cur, arg) == TRIE_NODE_TAKEN)
+            break;
+    }
+
+    trie_iter_free(&it);
+}
+
+/* 没有数据、只有一个静态子节点的中间节点，radix 模式下会与子节点合并 */
+static bool trie_node_collapsible(const trie_node_t *node)
+{
+    return node->parent && !node->udata && !(node->state & TRIE_STATE_KEY) &&
+           node->kind == TRIE_CHILD_ONE && !node->param && !node->wild &&
+           !trie_is_pattern(node->key.str);
+}
+
+static void trie_stats_node(trie_stats_t *st, const trie_node_t *node, size_t level)
+{
+    size_t fanout = node->nchild + (node->param != NULL) + (node->wild != NULL);
+
+    st->nnode++;
+    if (node->udata)
+        st->ndata++;
+    if (level > st->max_depth)
+        st->max_depth = level;
+    st->depth_hist[level < TRIE_STATS_DEPTH ? level : TRIE_STATS_DEPTH - 1]++;
+    st->fanout_hist[fanout < TRIE_STATS_FANOUT ? fanout : TRIE_STATS_FANOUT - 1]++;
+
+    st->node_bytes += sizeof(trie_node_t);
+    if (node->key.str)
+        st->token_bytes += node->toklen + 1;
+    if (node->kind == TRIE_CHILD_SMALL)
+        st->small_bytes += sizeof(struct trie_small);
+    else if (node->kind == TRIE_CHILD_HASH)
+        st->hash_bytes += hash_table_memory(node->childs.hash);
+
+    if (trie_node_collapsible(node)) {
+        st->chain_nodes++;
+        if (level == 0 || !trie_node_collapsible(node->parent))
+            st->nchain++;
+    }
+}
+
+void trie_stats(trie_node_t *node, trie_stats_t *st)
+{
+    struct trie_arena *ar = trie_arena_of(node);
+    trie_iter_t it;
+    trie_node_t *cur;
+
+    memset(st, 0, sizeof(*st));
+    trie_stats_node(st, node, 0);
+
+    trie_iter_init(&it);
+    trie_iter_begin(&it, node, TRIE_ITER_PRE);
+    while ((cur = trie_iter_next(&it)) != NULL)
+        trie_stats_node(st, cur, it.level);
+    trie_iter_free(&it);
+
+    if (ar) {
+        for (struct trie_block *blk = ar->blocks; blk; blk = blk->next)
+            st->arena_bytes += sizeof(struct trie_block) + blk->size;
+    }
+}
+
+/* 优先级：静态段 > 参数段 > 通配段，失败时回溯到下一优先级 */
+static trie_node_t *trie_match(trie_node_t *node, const char *path, uint32_t pos, uint32_t end,
+                               trie_param_t *params, int n, int cap, int *nparams)
+{
+    const char *rem = path + pos;
+    uint32_t remlen = end - pos;
+    trie_node_t *child, *found;
+    struct trie_key key;
+
+    trie_key_segment(&key, rem);
+
+    child = child_find(node, &key);
+    if (child) {
+        uint32_t b = radix_common(child, rem, remlen);
+
+        if (b == child->toklen) {
+            if (b == remlen) {
+                if (child->udata) {
+                    *nparams = n;
+                    return child;
+                }
+            } else if ((found = trie_match(child, path, pos + b + 1, end, params, n, cap, nparams))) {
+                return found;
+            }
+        }
+    }
+
+    child = node->param;
+    if (child && key.len > 0) {
+        if (n < cap) {
+            params[n].name = child->key.str + 1;
+            params[n].off = pos;
+            params[n].len = key.len;
+        }
+
+        if (key.len == remlen) {
+            if (child->udata) {
+                *nparams = n + 1;
+                return child;
+            }
+        } else if ((found = trie_match(child, path, pos + key.len + 1, end, params, n + 1, cap, nparams))) {
+            return found;
+        }
+    }
+
+    child = node->wild;
+    if (child && child->udata) {
+        if (n < cap) {
+            params[n].name = child->key.str + 1;
+            params[n].off = pos;
+            params[n].len = remlen;
+        }
+        *nparams = n + 1;
+        return child;
+    }
+
+    return NULL;
+}
+
+trie_node_t *trie_node_match(trie_node_t *parent, const char *path, trie_param_t *params, int *nparams)
+{
+    int cap = *nparams;
+
+    *nparams = 0;
+    return trie_match(parent, path, 1, (uint32_t)strlen(path), params, 0, cap, nparams);
+}
+
+void trie_node_set_data(trie_node_t *node, void *data, trie_node_free_fn_t fun)
+{
+    node->udata = data;
+    node->ufree = fun;
+    arena_hook(trie_arena_of(node), node);
+}
+
+void *trie_node_get_data(trie_node_t *node)
+{
+    return node->udata;
+}
+
+const char *trie_node_get_token(trie_node_t *node)
+{
+    return node->key.str;
+}
+
+static int trie_node_cmp(const void *a, const void *b)
+{
+    return trie_key_cmp(&(*(trie_node_t *const *)a)->key, &(*(trie_node_t *const *)b)->key);
+}
+
+struct trie_blob {
+    char *buf;
+    size_t len, cap;
+    hash_table_t *seen;
+};
+
+/* 把标签放入 token 数据区，相同的标签只存一份 */
+static uint32_t trie_blob_intern(struct trie_blob *blob, const char *token, uint32_t len)
+{
+    void *off;
+
+    if (hash_table_get_pair(blob->seen, token, NULL, &off))
+        return (uint32_t)(uintptr_t)off;
+
+    while (blob->len + len + 1 > blob->cap) {
+        blob->cap = blob->cap ? blob->cap * 2 : 4096;
+        blob->buf = xrealloc(blob->buf, blob->cap);
+    }
+
+    uint32_t pos = (uint32_t)blob->len;
+    memcpy(blob->buf + pos, token, len + 1);
+    blob->len += len + 1;
+
+    hash_table_put(blob->seen, token, (void *)(uintptr_t)pos);
+    return pos;
+}
+
+void *trie_node_compile(trie_node_t *root, trie_flat_value_fn_t fun, void *arg, size_t *size)
+{
+    size_t cap = 1024, n = 1;
+    trie_node_t **queue = xnew_array(trie_node_t *, cap);
+    struct trie_flat_node *nodes = xnew_array(struct trie_flat_node, cap);
+    struct trie_blob blob = {NULL, 0, 0, make_string_hash_table(0)};
+
+    queue[0] = root;
+    trie_blob_intern(&blob, "", 0);
+
+    /* 广度优先：处理 queue[i] 时把它的子节点依次追加到队尾 */
+    for (size_t i = 0; i < n; i++) {
+        trie_node_t *node = queue[i];
+        struct trie_flat_node *fn;
+        uint32_t extra = (node->param != NULL) + (node->wild != NULL);
+
+        while (n + node->nchild + extra > cap) {
+            cap *= 2;
+            queue = xrealloc(queue, cap * sizeof(trie_node_t *));
+            nodes = xrealloc(nodes, cap * sizeof(struct trie_flat_node));
+        }
+
+        fn = &nodes[i];
+        memset(fn, 0, sizeof(*fn));
+        if (node->key.str) {
+            fn->tok_off = trie_blob_intern(&blob, node->key.str, node->toklen);
+            fn->tok_len = node->toklen;
+            fn->key_len = node->key.len;
+        }
+        if (node->udata)
+            fn->value = fun ? fun(node, arg) : (uint64_t)(uintptr_t)node->udata;
+        else
+            fn->value = TRIE_FLAT_NONE;
+
+        fn->child = (uint32_t)n;
+        fn->nchild = node->nchild;
+
+        child_iter_t ci;
+        trie_node_t *child;
+        size_t first = n;
+
+        child_iter_init(&ci, node);
+        while ((child = child_iter_next(&ci)) && child != node->param && child != node->wild)
+            queue[n++] = child;
+        qsort(queue + first, n - first, sizeof(trie_node_t *), trie_node_cmp);
+
+        if (node->param) {
+            fn->param = (uint32_t)n;
+            queue[n++] = node->param;
+        }
+        if (node->wild) {
+            fn->wild = (uint32_t)n;
+            queue[n++] = node->wild;
+        }
+    }
+
+    size_t nsize = n * sizeof(struct trie_flat_node);
+    size_t total = sizeof(struct trie_flat_hdr) + nsize + blob.len;
+    char *image = xmalloc(total);
+    struct trie_flat_hdr *hdr = (struct trie_flat_hdr *)image;
+
+    hdr->magic = TRIE_FLAT_MAGIC;
+    hdr->version = TRIE_FLAT_VERSION;
+    hdr->flag = root->flag;
+    hdr->nnode = (uint32_t)n;
+    hdr->toksize = blob.len;
+    hdr->size = total;
+
+    memcpy(image + sizeof(*hdr), nodes, nsize);
+    memcpy(image + sizeof(*hdr) + nsize, blob.buf, blob.len);
+
+    hash_table_destroy(blob.seen);
+    xfree(blob.buf);
+    xfree(nodes);
+    xfree(queue);
+
+    *size = total;
+    return image;
+}
+
+#ifdef TEST_TRIE
+
+#include <stdio.h>
+#include <time.h>
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int nfreed;
+
+static void count_free(void *data)
+{
+    (void)data;
+    nfreed++;
+}
+
+static size_t nvisit;
+
+static void count_node(struct trie_arena *ar, trie_node_t *node)
+{
+    (void)ar;
+    (void)node;
+    nvisit++;
+}
+
+static size_t trie_count(trie_node_t *node)
+{
+    nvisit = 0;
+    trie_walk_post(NULL, node, count_node);
+    return nvisit;
+}
+
+/* 路由匹配：静态段 > 参数段 > 通配段，失败时回溯，参数按 (off, len) 切出 */
+static const char *const match_routes[] = {
+    "/users/new", "/users/:id", "/users/:id/posts", "/users/:id/posts/:pid",
+    "/files/*rest", "/files/readme", "/a/b/c", "/a/:p/d", "/a/*all",
+};
+
+static const struct {
+    const char *path;
+    int route; /* match_routes 的下标，-1 表示不匹配 */
+    int nparam;
+    const char *name[2];
+    uint32_t off[2], len[2];
+} match_cases[] = {
+    {"/users/new", 0, 0, {NULL}, {0}, {0}},
+    {"/users/42", 1, 1, {"id"}, {7}, {2}},
+    {"/users/", -1, 0, {NULL}, {0}, {0}},
+    {"/users/42/posts", 2, 1, {"id"}, {7}, {2}},
+    {"/users/new/posts", 2, 1, {"id"}, {7}, {3}},
+    {"/users/42/posts/7", 3, 2, {"id", "pid"}, {7, 16}, {2, 1}},
+    {"/users/42/comments", -1, 0, {NULL}, {0}, {0}},
+    {"/files/readme", 5, 0, {NULL}, {0}, {0}},
+    {"/files/docs/a.txt", 4, 1, {"rest"}, {7}, {10}},
+    {"/files/readme/v2", 4, 1, {"rest"}, {7}, {9}},
+    {"/a/b/c", 6, 0, {NULL}, {0}, {0}},
+    {"/a/b/d", 7, 1, {"p"}, {3}, {1}},
+    {"/a/b/e", 8, 1, {"all"}, {3}, {3}},
+    {"/a/x/d", 7, 1, {"p"}, {3}, {1}},
+    {"/a/b", 8, 1, {"all"}, {3}, {1}},
+};
+
+static int check_match(int flag)
+{
+    trie_node_t *root = trie_node_create(flag);
+    const int nroute = (int)(sizeof(match_routes) / sizeof(match_routes[0]));
+    trie_param_t params[2];
+    int ret = 0;
+
+    for (int i = 0; i < nroute; i++) {
+        trie_node_t *node = trie_node_insert(root, match_routes[i]);
+        if (!node) {
+            ret = (printf("FAIL flag %d insert %s\n", flag, match_routes[i]), 1);
+            goto out;
+        }
+        trie_node_set_data(node, (void *)match_routes[i], NULL);
+    }
+
+    /* 通配段只能是最后一段 */
+    if (trie_node_insert(root, "/files/*rest/more") || trie_node_insert(root, "/x/*rest/more")) {
+        ret = (printf("FAIL flag %d insert after wildcard accepted\n", flag), 1);
+        goto out;
+    }
+
+    for (size_t c = 0; c < sizeof(match_cases) / sizeof(match_cases[0]); c++) {
+        int np = 2;
+        trie_node_t *node = trie_node_match(root, match_cases[c].path, params, &np);
+        const char *want = match_cases[c].route < 0 ? NULL : match_routes[match_cases[c].route];
+
+        if ((node ? trie_node_get_data(node) : NULL) != want) {
+            ret = (printf("FAIL flag %d match %s -> %s\n", flag, match_cases[c].path,
+                          node ? (char *)trie_node_get_data(node) : "NULL"), 1);
+            goto out;
+        }
+        if (!node)
+            continue;
+        if (np != match_cases[c].nparam) {
+            ret = (printf("FAIL flag %d match %s nparams %d\n", flag, match_cases[c].path, np), 1);
+            goto out;
+        }
+        for (int k = 0; k < np; k++) {
+            if (strcmp(params[k].name, match_cases[c].name[k]) || params[k].off != match_cases[c].off[k] ||
+                params[k].len != match_cases[c].len[k]) {
+                ret = (printf("FAIL flag %d match %s param %d %s (%u, %u)\n", flag, match_cases[c].path, k,
+                              params[k].name, params[k].off, params[k].len), 1);
+                goto out;
+            }
+        }
+    }
+
+    /* 容量不足时仍返回匹配的节点和参数总数，只写入容量内的参数 */
+    int np = 1;
+    params[1].name = NULL;
+    if (trie_node_match(root, "/users/42/posts/7", params, &np) == NULL || np != 2 || params[1].name != NULL)
+        ret = (printf("FAIL flag %d match with short params\n", flag), 1);
+
+out:
+    trie_node_delete(root);
+    return ret;
+}
+
+/* 四种模式对同一串随机插入、删除操作的结果必须与模型一致：
+   插入只在路径合法且未被显式插入过时返回节点，删除去掉以该前缀开头的全部路径，
+   radix 模式下删除后重新合并的节点仍能查到，中间节点被显式插入时同样返回节点 */
+#define MODEL_SEGS 5
+#define MODEL_PATHS (MODEL_SEGS + MODEL_SEGS * MODEL_SEGS + MODEL_SEGS * MODEL_SEGS * MODEL_SEGS)
+
+static char model_path[MODEL_PATHS][32];
+static int model_valid[MODEL_PATHS];
+
+static void model_init(void)
+{
+    static const char *const segs[MODEL_SEGS] = {"a", "ab", "b", ":id", "*w"};
+    int n = 0;
+
+    for (int depth = 1; depth <= 3; depth++) {
+        int count = depth == 1 ? MODEL_SEGS : depth == 2 ? MODEL_SEGS * MODEL_SEGS : MODEL_PATHS - n;
+
+        for (int k = 0; k < count; k++, n++) {
+            char *p = model_path[n];
+            int v = k;
+
+            model_valid[n] = 1;
+            p[0] = '\0';
+            for (int d = 0; d < depth; d++, v /= MODEL_SEGS) {
+                strcat(p, "/");
+                strcat(p, segs[v % MODEL_SEGS]);
+                if (v % MODEL_SEGS == MODEL_SEGS - 1 && d + 1 < depth)
+                    model_valid[n] = 0;
+            }
+        }
+    }
+}
+
+static int model_has_prefix(const char *path, const char *prefix)
+{
+    size_t n = strlen(prefix);
+
+    return !strncmp(path, prefix, n) && (path[n] == '\0' || path[n] == '/');
+}
+
+static int check_modes(void)
+{
+    trie_node_t *roots[4];
+    int present[MODEL_PATHS] = {0};
+    int ret = 0;
+
+    model_init();
+    for (int f = 0; f < 4; f++)
+        roots[f] = trie_node_create(f);
+
+    srand(27);
+    for (int op = 0; op < 20000 && !ret; op++) {
+        int k = rand() % MODEL_PATHS;
+        const char *path = model_path[k];
+
+        if (rand() % 10 < 7) {
+            int want = model_valid[k] && !present[k];
+
+            for (int f = 0; f < 4; f++) {
+                trie_node_t *node = trie_node_insert(roots[f], path);
+                if ((node != NULL) != want) {
+                    ret = (printf("FAIL op %d flag %d insert %s returned %p\n", op, f, path, (void *)node), 1);
+                    break;
+                }
+                if (node)
+                    trie_node_set_data(node, model_path[k], NULL);
+            }
+            present[k] |= want;
+        } else {
+            for (int f = 0; f < 4; f++)
+                trie_node_remove(roots[f], path);
+            for (int j = 0; j < MODEL_PATHS; j++) {
+                if (model_has_prefix(model_path[j], path))
+                    present[j] = 0;
+            }
+        }
+
+        for (int j = 0; j < MODEL_PATHS && !ret; j++) {
+            for (int f = 0; f < 4; f++) {
+                trie_node_t *node = trie_node_search(roots[f], model_path[j]);
+                void *data = node ? trie_node_get_data(node) : NULL;
+
+                if (present[j] ? data != model_path[j] : data != NULL) {
+                    ret = (printf("FAIL op %d flag %d search %s present %d\n", op, f, model_path[j], present[j]), 1);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int f = 0; f < 4; f++)
+        trie_node_delete(roots[f]);
+    return ret;
+}
+
+/* 批量查找的结果必须与逐条 trie_node_search 相同：输入乱序、含重复，
+   并且足够大，能拆分到多个线程 */
+static int check_batch(int flag)
+{
+    const size_t n = 3 * TRIE_BATCH_CHUNK + 17;
+    trie_node_t *root = trie_node_create(flag);
+    char **paths = xnew_array(char *, n);
+    trie_node_t **want = xnew_array(trie_node_t *, n);
+    trie_node_t **out = xnew_array(trie_node_t *, n);
+    const char *const **order = xnew_array(const char *const *, n);
+    char path[64];
+    int ret = 0;
+
+    for (int i = 0; i < 3000; i++) {
+        snprintf(path, sizeof(path), "/v%d/users/%d/items/%d", i % 3, i % 97, i);
+        trie_node_insert(root, path);
+    }
+    trie_node_insert(root, "/v0/users/:id/posts");
+    trie_node_insert(root, "/v1/files/*rest");
+
+    srand(37);
+    for (size_t k = 0; k < n; k++) {
+        int i = rand() % 3600;
+
+        switch (rand() % 4) {
+        case 0:
+            snprintf(path, sizeof(path), "/v%d/users/%d", i % 3, i % 97);
+            break;
+        case 1:
+            snprintf(path, sizeof(path), "%s", rand() % 2 ? "/v0/users/:id/posts" : "/v1/files/*rest");
+            break;
+        default:
+            snprintf(path, sizeof(path), "/v%d/users/%d/items/%d", i % 3, i % 97, i);
+            break;
+        }
+        paths[k] = strdup(path);
+        want[k] = trie_node_search(root, path);
+    }
+    for (size_t k = 0; k < n; k++)
+        order[k] = (const char *const *)&paths[k];
+    qsort(order, n, sizeof(*order), trie_batch_cmp);
+
+    for (int mode = 0; mode < 6 && !ret; mode++) {
+        memset(out, 0xff, n * sizeof(*out));
+        if (mode < 4)
+            trie_node_search_batch(root, (const char *const *)paths, n, out, mode);
+        else
+            trie_batch_split(root, (const char *const *)paths, mode == 5 ? order : NULL, n, out, 4);
+
+        for (size_t k = 0; k < n; k++) {
+            if (out[k] != want[k]) {
+                ret = (printf("FAIL flag %d batch mode %d %s\n", flag, mode, paths[k]), 1);
+                break;
+            }
+        }
+    }
+
+    for (size_t k = 0; k < n; k++)
+        free(paths[k]);
+    xfree(paths);
+    xfree(want);
+    xfree(out);
+    xfree(order);
+    trie_node_delete(root);
+    return ret;
+}
+
+/* 每条路径新增 3 个节点，构造约 n 个节点的 trie，删除 /t0 子树后检查其余
+   63 棵子树仍可查找，再计时删除整棵树。每个叶子挂一个 ufree 用来核对释放的节点，
+   遍历的节点数与树的规模一致；malloc 模式下每节点耗时还受分配器与缓存影响，
+   会随规模增长，arena 模式只与内存块数有关 */
+int main(void)
+{
+    static const int flags[] = {0, TRIE_FLAG_ARENA};
+    char path[64];
+
+    for (int f = 0; f < 4; f++) {
+        if (check_match(f))
+            return 1;
+    }
+    if (check_modes())
+        return 1;
+    for (int f = 0; f < 4; f++) {
+        if (check_batch(f))
+            return 1;
+    }
+
+    for (int f = 0; f < 2; f++) {
+        for (int n = 250000; n <= 1000000; n *= 2) {
+            trie_node_t *root = trie_node_create(flags[f]);
+            int npath = n / 3, nt0 = 0;
+
+            for (int i = 0; i < npath; i++) {
+                snprintf(path, sizeof(path), "/t%d/api/%d/items/%d", i % 64, i / 64, i);
+                trie_node_set_data(trie_node_insert(root, path), NULL, count_free);
+                nt0 += i % 64 == 0;
+            }
+            size_t total = trie_count(root);
+
+            nfreed = 0;
+            double t0 = now();
+            trie_node_remove(root, "/t0");
+            double t1 = now();
+            size_t left = trie_count(root);
+
+            if (nfreed != nt0)
+                return printf("FAIL remove /t0 freed %d of %d leaves\n", nfreed, nt0), 1;
+            for (int i = 0; i < npath; i++) {
+                snprintf(path, sizeof(path), "/t%d/api/%d/items/%d", i % 64, i / 64, i);
+                if ((trie_node_search(root, path) != NULL) != (i % 64 != 0))
+                    return printf("FAIL search %s after remove /t0\n", path), 1;
+            }
+
+            nfreed = 0;
+            double t2 = now();
+            trie_node_delete(root);
+            double t3 = now();
+
+            if (nfreed != npath - nt0)
+                return printf("FAIL delete freed %d of %d leaves\n", nfreed, npath - nt0), 1;
+            printf("flag %d nodes %7zu remove /t0 %6zu nodes %.4fs delete %7zu nodes %.4fs (%.1f ns/node)\n",
+                   flags[f], total, total - left, t1 - t0, left, t3 - t2, (t3 - t2) * 1e9 / left);
+        }
+    }
+
+    /* arena 模式删除整棵树：根节点的 64 个子节点放在哈希表里，每 1000 条路径
+       挂一个 ufree，删除只处理这些节点并逐块释放内存，耗时应随内存块数线性增长 */
+    for (int n = 250000; n <= 1000000; n *= 2) {
+        trie_node_t *root = trie_node_create(TRIE_FLAG_ARENA);
+        struct trie_arena *ar = &((struct trie_root *)root)->arena;
+        int nset = 0, nblocks = 0;
+
+        nfreed = 0;
+        for (int i = 0; i < n / 3; i++) {
+            snprintf(path, sizeof(path), "/t%d/api/%d/items/%d", i % 64, i / 64, i);
+            trie_node_t *node = trie_node_insert(root, path);
+            if (i % 1000 == 0) {
+                trie_node_set_data(node, NULL, count_free);
+                nset++;
+            }
+        }
+        trie_node_remove(root, "/t0");
+        uint32_t nhooks = ar->nhooks;
+        for (struct trie_block *blk = ar->blocks; blk; blk = blk->next)
+            nblocks++;
+
+        double t0 = now();
+        trie_node_delete(root);
+        double t1 = now();
+
+        if (nfreed != nset)
+            return printf("FAIL arena delete freed %d of %d\n", nfreed, nset), 1;
+        printf("arena nodes %7d blocks %4d hooks %4u delete %.6fs (%.1f ns/block)\n", n, nblocks, nhooks,
+               t1 - t0, (t1 - t0) * 1e9 / nblocks);
+    }
+
+    /* 切分长 REST 路径的耗时，对比逐段 strchr 的做法，以及只计算各段哈希的耗时。
+       三者都受哈希的依赖链限制，各取 5 轮中最快的一轮 */
+    static const char url[] = "/api/v2/organizations/acme-corporation/projects/backend-services"
+                              "/repositories/route-table/branches/release-2024/commits/4f1c2e9a7b";
+    const size_t nbyte = sizeof(url) - 1;
+    const int rounds = 1000000;
+    double best[3] = {1e9, 1e9, 1e9};
+    trie_path_t tp;
+    uint32_t sum = 0;
+
+    trie_path_init(&tp);
+    trie_path_parse(&tp, url);
+    for (uint32_t k = 0; k < tp.nseg; k++) {
+        uint32_t h = 0;
+        for (uint32_t c = 0; c < tp.segs[k].len; c++)
+            h = h * 31 + (unsigned char)tp.str[tp.segs[k].off + c];
+        if (h != tp.segs[k].hash)
+            return printf("FAIL hash of segment %u\n", k), 1;
+    }
+
+    for (int r = 0; r < 5; r++) {
+        double t0 = now();
+        for (int i = 0; i < rounds; i++) {
+            trie_path_parse(&tp, url);
+            sum += tp.segs[tp.nseg - 1].hash;
+        }
+        double t1 = now();
+        for (int i = 0; i < rounds; i++) {
+            for (const char *pos = url + 1;; pos = strchr(pos, '/') + 1) {
+                struct trie_key key;
+                trie_key_segment(&key, pos);
+                sum += key.hash;
+                if (pos[key.len] == '\0')
+                    break;
+            }
+        }
+        double t2 = now();
+        for (int i = 0; i < rounds; i++) {
+            for (uint32_t k = 0; k < tp.nseg; k++)
+                sum += trie_hash(tp.str + tp.segs[k].off, tp.segs[k].len);
+            __asm__ volatile("" : : "r"(url) : "memory");
+        }
+        double t3 = now();
+
+        best[0] = t1 - t0 < best[0] ? t1 - t0 : best[0];
+        best[1] = t2 - t1 < best[1] ? t2 - t1 : best[1];
+        best[2] = t3 - t2 < best[2] ? t3 - t2 : best[2];
+    }
+    trie_path_free(&tp);
+
+    printf("tokenize %zu bytes: parse %.2f ns/byte strchr %.2f ns/byte hash only %.2f ns/byte (%u)\n", nbyte,
+           best[0] * 1e9 / rounds / nbyte, best[1] * 1e9 / rounds / nbyte, best[2] * 1e9 / rounds / nbyte, sum);
+
+    return 0;
 }
+#endif /* TEST_TRIE */
@@ -7,16 +7,116 @@
 #define TRIE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define TRIE_NODE_TAKEN 0x1
 #define TRIE_NODE_CONTINUE 0x1
 
+/**
+ * @brief radix(路径压缩)模式：单子节点链合并成一条边，
+ *        边的标签是以'/'连接的多个段。
+ *        该模式下只有插入过的路径和分叉点才是节点，
+ *        trie_node_search 不会返回落在标签中间的路径；
+ *        删除后无数据的单子节点会与子节点重新合并并被释放。
+ */
+#define TRIE_FLAG_RADIX 0x1
+
+/**
+ * @brief arena模式：节点、token和小数组从整棵树共享的内存块中分配，
+ *        删除根节点时只需释放这些内存块(有ufree或大扇出节点时才需要遍历)。
+ *        删除子树的内存会被复用，但直到整棵树删除才归还给系统。
+ */
+#define TRIE_FLAG_ARENA 0x2
+
 
 /**
  * @brief trie树节点结构体
  */
 typedef struct trie_node trie_node_t;
 
+/**
+ * @brief 路由匹配时捕获的参数，off/len 是参数值在请求路径中的位置
+ */
+typedef struct trie_param {
+    const char *name; /**< 参数名，不含前缀的':'或'*' */
+    uint32_t off;     /**< 参数值在路径中的偏移 */
+    uint32_t len;     /**< 参数值的长度 */
+} trie_param_t;
+
+/**
+ * @brief 迭代器的遍历顺序，两者同时设置时每个节点返回两次
+ */
+#define TRIE_ITER_PRE 0x1
+#define TRIE_ITER_POST 0x2
+
+/**
+ * @brief 不分配节点内存的迭代遍历器，栈和路径缓冲区在多次遍历间复用。
+ *        遍历期间不能修改trie树。
+ */
+typedef struct trie_iter {
+    void *frames;          /**< 连续的栈帧数组 */
+    size_t depth, cap;     /**< 栈深度与容量 */
+    char *path;            /**< 当前节点的完整路径，随遍历增量维护 */
+    size_t pathlen, pathcap;
+    trie_node_t *pending;  /**< 上次返回、尚未展开的节点 */
+    int order;             /**< TRIE_ITER_PRE/TRIE_ITER_POST 的组合 */
+    int skip;              /**< 不展开pending的子节点 */
+    int post;              /**< 当前节点是否为后序返回 */
+    size_t level;          /**< 当前节点的深度，起始节点的子节点为1 */
+} trie_iter_t;
+
+/**
+ * @brief 路径中的一段，hash 与查找子节点时使用的哈希相同
+ */
+typedef struct trie_seg {
+    uint32_t off;  /**< 段在 str 中的偏移 */
+    uint32_t len;  /**< 段长度，不含'/' */
+    uint32_t hash; /**< 段的哈希值 */
+} trie_seg_t;
+
+/**
+ * @brief trie_path_t 内嵌的段数组容量
+ */
+#define TRIE_PATH_INLINE 16
+
+/**
+ * @brief 切分好的路径，段数不超过 TRIE_PATH_INLINE 时不分配内存。
+ *        segs 可能指向结构体自身，不能按值复制。
+ */
+typedef struct trie_path {
+    const char *str;   /**< 去掉开头'/'的路径 */
+    uint32_t len;      /**< str 的长度 */
+    uint32_t nseg;     /**< 段数，至少为1 */
+    uint32_t cap;      /**< segs 的容量 */
+    trie_seg_t *segs;  /**< 各段的位置和哈希 */
+    trie_seg_t inline_segs[TRIE_PATH_INLINE];
+} trie_path_t;
+
+/**
+ * @brief 深度直方图与扇出直方图的桶数，超出的计入最后一个桶
+ */
+#define TRIE_STATS_DEPTH 32
+#define TRIE_STATS_FANOUT 16
+
+/**
+ * @brief trie树的内存与形状统计
+ */
+typedef struct trie_stats {
+    size_t nnode;                          /**< 节点数，包括起始节点 */
+    size_t ndata;                          /**< 设置了用户数据的节点数 */
+    size_t max_depth;                      /**< 最大深度，起始节点为0 */
+    size_t depth_hist[TRIE_STATS_DEPTH];   /**< 各深度的节点数 */
+    size_t fanout_hist[TRIE_STATS_FANOUT]; /**< 各扇出(含参数和通配子节点)的节点数 */
+    size_t token_bytes;                    /**< token字符串占用的字节数，含结尾的'\0' */
+    size_t node_bytes;                     /**< 节点结构体占用的字节数 */
+    size_t small_bytes;                    /**< 有序小数组占用的字节数 */
+    size_t hash_bytes;                     /**< 子节点哈希表占用的字节数 */
+    size_t arena_bytes;                    /**< arena模式下已申请的内存块字节数，上面各项都从中分配 */
+    size_t nchain;                         /**< 可由路径压缩消除的单子节点链条数 */
+    size_t chain_nodes;                    /**< 这些链条中可消除的节点数 */
+} trie_stats_t;
+
 /**
  * @brief 遍历trie树节点时的回调函数类型
  * @param node 当前遍历到的trie树节点
@@ -37,6 +137,13 @@ typedef void (*trie_node_free_fn_t)(void *data);
  */
 trie_node_t *trie_node_new();
 
+/**
+ * @brief 按指定模式创建一个trie树的根节点
+ * @param flag 模式标志，TRIE_FLAG_RADIX 与 TRIE_FLAG_ARENA 的组合，子节点继承根节点的模式
+ * @return 新创建的trie树节点指针
+ */
+trie_node_t *trie_node_create(int flag);
+
 /**
  * @brief 删除一个trie树节点及其所有子节点
  * @param node 待删除的trie树节点指针
@@ -45,9 +152,13 @@ void trie_node_delete(trie_node_t *node);
 
 /**
  * @brief 在trie树中插入一个字符串
+ *        以':'开头的段是参数段，如"/users/:id"，匹配任意非空的一段；
+ *        以'*'开头的段是通配段，如"*path"，匹配剩余的全部路径，只能是最后一段。
+ *        同一位置只有一个参数节点，参数名以第一次插入的为准。
  * @param parent 父节点指针
  * @param prefix 待插入的字符串
- * @return 插入的trie树节点指针，如果字符串已存在则返回NULL
+ * @return 插入的trie树节点指针。字符串此前只是其他字符串的中间节点时也返回该节点，
+ *         radix 与按段两种模式规则相同；字符串已被插入过，或通配段后还有其他段则返回NULL
  */
 trie_node_t *trie_node_insert(trie_node_t *parent, const char *prefix);
 
@@ -59,6 +170,57 @@ trie_node_t *trie_node_insert(trie_node_t *parent, const char *prefix);
  */
 trie_node_t *trie_node_search(trie_node_t *parent, const char *prefix);
 
+/**
+ * @brief 用已切分好的路径查找，同一路径在多棵树中查找时只需切分一次
+ * @param parent 父节点指针
+ * @param tp 由 trie_path_parse 切分的路径
+ * @return 查找到的trie树节点指针，如果路径不存在则返回NULL
+ */
+trie_node_t *trie_node_search_path(trie_node_t *parent, const trie_path_t *tp);
+
+/**
+ * @brief trie_node_search_batch 的选项：先按字典序排序再查找，
+ *        相邻路径的公共前缀更长，结果仍按输入顺序写入
+ */
+#define TRIE_BATCH_SORT 0x1
+
+/**
+ * @brief trie_node_search_batch 的选项：批量较大时按在线CPU数拆分到多个线程，
+ *        查找期间不能修改trie树
+ */
+#define TRIE_BATCH_PARALLEL 0x2
+
+/**
+ * @brief 批量精确查找，相邻路径的公共前缀沿用上一条路径已走过的节点，不再从根节点开始
+ * @param parent 父节点指针
+ * @param paths 待查找的路径数组
+ * @param n 路径个数
+ * @param out 输出每条路径查找到的节点，不存在为NULL，语义同 trie_node_search
+ * @param flag TRIE_BATCH_SORT 与 TRIE_BATCH_PARALLEL 的组合
+ */
+void trie_node_search_batch(trie_node_t *parent, const char *const *paths, size_t n,
+                            trie_node_t **out, int flag);
+
+/**
+ * @brief 最长前缀匹配：一次遍历找到路径上最深的、设置了用户数据的节点
+ * @param parent 父节点指针
+ * @param prefix 待查找的路径
+ * @param matched_len 输出该节点对应的路径前缀长度，如"/api/v1/x"匹配到"/api/v1"时为7
+ * @return 最深的带用户数据的节点指针，没有则返回NULL且matched_len为0
+ */
+trie_node_t *trie_node_longest_prefix(trie_node_t *parent, const char *prefix, size_t *matched_len);
+
+/**
+ * @brief 按路由规则匹配请求路径，优先级为 静态段 > 参数段 > 通配段，
+ *        只有设置了用户数据的节点才算匹配成功，不分配内存
+ * @param parent 父节点指针
+ * @param path 请求路径
+ * @param params 保存捕获参数的数组
+ * @param nparams 输入为params的容量，输出为捕获的参数个数，大于容量时多出的参数不会写入
+ * @return 匹配到的trie树节点指针，没有匹配的路由则返回NULL
+ */
+trie_node_t *trie_node_match(trie_node_t *parent, const char *path, trie_param_t *params, int *nparams);
+
 /**
  * @brief 在trie树中删除一个字符串
  * @param node 待删除的trie树节点指针
@@ -84,10 +246,62 @@ void *trie_node_get_data(trie_node_t *node);
 /**
  * @brief 获取trie树节点的token字符串
  * @param node 待获取用户数据的trie树节点指针
- * @return token字符串
+ * @return token字符串，radix模式下是整条边的标签，如"api/v1" 
  */
 const char *trie_node_get_token(trie_node_t *node);
 
+/**
+ * @brief 初始化路径
+ * @param tp 路径
+ */
+void trie_path_init(trie_path_t *tp);
+
+/**
+ * @brief 按'/'切分路径并计算每段的哈希，可以重复调用以复用段数组
+ * @param tp 已初始化的路径
+ * @param path 以'/'开头的路径，切分结果引用该字符串，使用期间不能释放
+ */
+void trie_path_parse(trie_path_t *tp, const char *path);
+
+/**
+ * @brief 释放路径的段数组
+ * @param tp 路径
+ */
+void trie_path_free(trie_path_t *tp);
+
+/**
+ * @brief 初始化迭代器
+ * @param it 迭代器
+ */
+void trie_iter_init(trie_iter_t *it);
+
+/**
+ * @brief 释放迭代器的栈和路径缓冲区
+ * @param it 迭代器
+ */
+void trie_iter_free(trie_iter_t *it);
+
+/**
+ * @brief 开始遍历node的子孙节点(不包括node本身)，可以重复调用以复用缓冲区
+ * @param it 迭代器
+ * @param node 起始节点
+ * @param order 遍历顺序，TRIE_ITER_PRE/TRIE_ITER_POST 的组合
+ */
+void trie_iter_begin(trie_iter_t *it, trie_node_t *node, int order);
+
+/**
+ * @brief 返回下一个节点，通过 it->level、it->path、it->post 获取深度、完整路径和是否为后序
+ * @param it 迭代器
+ * @return 下一个节点，遍历结束返回NULL
+ */
+trie_node_t *trie_iter_next(trie_iter_t *it);
+
+/**
+ * @brief 剪枝：不再进入上一次前序返回的节点的子节点
+ * @param it 迭代器
+ */
+void trie_iter_skip(trie_iter_t *it);
+
 /**
  * @brief 前序遍历trie树
  * @param node 待遍历的trie树节点指针
@@ -96,4 +310,12 @@ const char *trie_node_get_token(trie_node_t *node);
  */
 void trie_node_foreach(trie_node_t *node, trie_node_visit_fn_t fun, void *arg);
 
+/**
+ * @brief 统计node子树的节点数、深度和扇出分布以及各部分的内存占用，
+ *        用于评估是否启用 TRIE_FLAG_RADIX 或 TRIE_FLAG_ARENA
+ * @param node 起始节点
+ * @param st 输出统计结果
+ */
+void trie_stats(trie_node_t *node, trie_stats_t *st);
+
 #endif /* TRIE_H */
\ No newline at end of file
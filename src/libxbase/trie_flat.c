@@ -0,0 +1,653 @@
+#include "trie_flat.h"
+#include "xmalloc.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct trie_flat {
+    const struct trie_flat_hdr *hdr;
+    const struct trie_flat_node *nodes;
+    const char *tokens;
+
+    void *map;
+    size_t size;
+};
+
+#ifndef _WIN32
+
+/* 让 rename 本身落盘：同步文件所在的目录 */
+static int trie_flat_sync_dir(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    char *dir = xmalloc(len + 2);
+    int fd, ret;
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (len == 0) {
+        strcpy(dir, "/");
+    } else {
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+
+    fd = open(dir, O_RDONLY);
+    xfree(dir);
+    if (fd < 0)
+        return -1;
+
+    ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+/*
+ * 临时文件由 mkstemp 在目标文件所在目录创建，多个写者互不覆盖；
+ * rename 前 fsync 文件，之后 fsync 目录，崩溃后目标路径上要么是旧快照要么是完整的新快照
+ */
+int trie_flat_write(const char *path, const void *image, size_t size)
+{
+    size_t len = strlen(path);
+    char *tmp = xmalloc(len + 8);
+    const char *p = image;
+    size_t left = size;
+    int fd;
+
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".XXXXXX", 8);
+
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        xfree(tmp);
+        return -1;
+    }
+
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+
+    /* mkstemp 创建的文件只有属主可读，快照要给其他进程读 */
+    if (left != 0 || fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+        close(fd);
+        unlink(tmp);
+        xfree(tmp);
+        return -1;
+    }
+
+    if (close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        xfree(tmp);
+        return -1;
+    }
+
+    xfree(tmp);
+    return trie_flat_sync_dir(path);
+}
+
+#else
+
+int trie_flat_write(const char *path, const void *image, size_t size)
+{
+    size_t len = strlen(path);
+    char *tmp = xmalloc(len + 5);
+    FILE *fp;
+
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        xfree(tmp);
+        return -1;
+    }
+
+    if (fwrite(image, 1, size, fp) != size || fclose(fp) != 0) {
+        remove(tmp);
+        xfree(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        xfree(tmp);
+        return -1;
+    }
+
+    xfree(tmp);
+    return 0;
+}
+
+#endif
+
+/* 检查头部和每个节点的偏移都落在快照范围内，之后的查找不再做边界检查 */
+static int trie_flat_check(const void *image, size_t size)
+{
+    const struct trie_flat_hdr *hdr = image;
+    const struct trie_flat_node *nodes = (const struct trie_flat_node *)(hdr + 1);
+    const char *tokens;
+
+    if (size < sizeof(*hdr) || hdr->magic != TRIE_FLAT_MAGIC || hdr->version != TRIE_FLAT_VERSION)
+        return -1;
+    if (hdr->size != size || hdr->nnode == 0 ||
+        (size - sizeof(*hdr)) / sizeof(*nodes) < hdr->nnode ||
+        size - sizeof(*hdr) - hdr->nnode * sizeof(*nodes) != hdr->toksize)
+        return -1;
+
+    tokens = (const char *)(nodes + hdr->nnode);
+    for (uint32_t i = 0; i < hdr->nnode; i++) {
+        const struct trie_flat_node *fn = &nodes[i];
+
+        if ((uint64_t)fn->tok_off + fn->tok_len >= hdr->toksize || tokens[fn->tok_off + fn->tok_len] != '\0')
+            return -1;
+        if (fn->key_len > fn->tok_len || (fn->nchild && fn->child <= i) ||
+            (uint64_t)fn->child + fn->nchild > hdr->nnode ||
+            fn->param >= hdr->nnode || fn->wild >= hdr->nnode)
+            return -1;
+    }
+
+    return 0;
+}
+
+trie_flat_t *trie_flat_attach(const void *image, size_t size)
+{
+    if (trie_flat_check(image, size) != 0)
+        return NULL;
+
+    trie_flat_t *tf = xnew0(trie_flat_t);
+
+    tf->hdr = image;
+    tf->nodes = (const struct trie_flat_node *)(tf->hdr + 1);
+    tf->tokens = (const char *)(tf->nodes + tf->hdr->nnode);
+    tf->size = size;
+
+    return tf;
+}
+
+#ifndef _WIN32
+
+trie_flat_t *trie_flat_open(const char *path)
+{
+    struct stat st;
+    trie_flat_t *tf;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    tf = trie_flat_attach(map, (size_t)st.st_size);
+    if (tf == NULL) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+
+    tf->map = map;
+    return tf;
+}
+
+void trie_flat_close(trie_flat_t *tf)
+{
+    if (!tf)
+        return;
+
+    if (tf->map)
+        munmap(tf->map, tf->size);
+    xfree(tf);
+}
+
+#else
+
+trie_flat_t *trie_flat_open(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    trie_flat_t *tf = NULL;
+    long size;
+    void *buf;
+
+    if (fp == NULL)
+        return NULL;
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        buf = xmalloc(size);
+        if (fread(buf, 1, size, fp) == (size_t)size)
+            tf = trie_flat_attach(buf, size);
+        if (tf)
+            tf->map = buf;
+        else
+            xfree(buf);
+    }
+
+    fclose(fp);
+    return tf;
+}
+
+void trie_flat_close(trie_flat_t *tf)
+{
+    if (!tf)
+        return;
+
+    xfree(tf->map);
+    xfree(tf);
+}
+
+#endif
+
+trie_flat_t *trie_flat_swap(trie_flat_t **slot, trie_flat_t *next)
+{
+    return __atomic_exchange_n(slot, next, __ATOMIC_ACQ_REL);
+}
+
+static const char *flat_token(const trie_flat_t *tf, const struct trie_flat_node *fn)
+{
+    return tf->tokens + fn->tok_off;
+}
+
+static uint32_t flat_segment(const char *rem)
+{
+    const char *end = strchr(rem, '/');
+
+    return end ? (uint32_t)(end - rem) : (uint32_t)strlen(rem);
+}
+
+/* 在已排序的静态子节点中二分查找第一段为 seg 的节点 */
+static const struct trie_flat_node *flat_child(const trie_flat_t *tf, const struct trie_flat_node *fn,
+                                               const char *seg, uint32_t len)
+{
+    uint32_t lo = fn->child, hi = fn->child + fn->nchild;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const struct trie_flat_node *c = &tf->nodes[mid];
+        uint32_t n = c->key_len < len ? c->key_len : len;
+        int res = memcmp(flat_token(tf, c), seg, n);
+
+        if (res == 0)
+            res = (int)c->key_len - (int)len;
+        if (res == 0)
+            return c;
+        if (res < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+/* 同 trie.c 中的 radix_common：在段边界上比较标签与剩余路径 */
+static uint32_t flat_common(const trie_flat_t *tf, const struct trie_flat_node *fn,
+                            const char *rem, uint32_t remlen)
+{
+    const char *label = flat_token(tf, fn);
+    uint32_t len = fn->tok_len;
+    uint32_t i = 0, b = 0;
+
+    while (i < len && i < remlen && label[i] == rem[i]) {
+        if (label[i] == '/')
+            b = i;
+        i++;
+    }
+
+    if ((i == len || label[i] == '/') && (i == remlen || rem[i] == '/'))
+        return i;
+
+    return b;
+}
+
+static const struct trie_flat_node *flat_step(const trie_flat_t *tf, const struct trie_flat_node *fn,
+                                              const char *rem, uint32_t remlen, uint32_t *consumed)
+{
+    uint32_t seglen = flat_segment(rem);
+    const struct trie_flat_node *c;
+
+    if (rem[0] == ':' || rem[0] == '*') {
+        uint32_t idx = rem[0] == ':' ? fn->param : fn->wild;
+
+        *consumed = seglen;
+        return idx ? &tf->nodes[idx] : NULL;
+    }
+
+    c = flat_child(tf, fn, rem, seglen);
+    if (c == NULL)
+        return NULL;
+
+    *consumed = flat_common(tf, c, rem, remlen);
+    return *consumed == c->tok_len ? c : NULL;
+}
+
+int trie_flat_search(const trie_flat_t *tf, const char *path, uint64_t *value)
+{
+    const struct trie_flat_node *fn = tf->nodes;
+    const char *rem = path + 1;
+    uint32_t remlen = (uint32_t)strlen(rem);
+
+    for (;;) {
+        uint32_t b;
+
+        fn = flat_step(tf, fn, rem, remlen, &b);
+        if (fn == NULL)
+            return -1;
+        if (b == remlen)
+            break;
+
+        rem += b + 1;
+        remlen -= b + 1;
+    }
+
+    if (value)
+        *value = fn->value;
+    return 0;
+}
+
+int trie_flat_longest_prefix(const trie_flat_t *tf, const char *path, size_t *matched_len, uint64_t *value)
+{
+    const struct trie_flat_node *fn = tf->nodes, *best = NULL;
+    const char *rem = path + 1;
+    uint32_t remlen = (uint32_t)strlen(rem);
+
+    *matched_len = 0;
+
+    for (;;) {
+        uint32_t b;
+
+        fn = flat_step(tf, fn, rem, remlen, &b);
+        if (fn == NULL)
+            break;
+
+        if (fn->value != TRIE_FLAT_NONE) {
+            best = fn;
+            *matched_len = (size_t)(rem + b - path);
+        }
+        if (b == remlen)
+            break;
+
+        rem += b + 1;
+        remlen -= b + 1;
+    }
+
+    if (best == NULL)
+        return -1;
+    if (value)
+        *value = best->value;
+    return 0;
+}
+
+static const struct trie_flat_node *flat_match(const trie_flat_t *tf, const struct trie_flat_node *fn,
+                                               const char *path, uint32_t pos, uint32_t end,
+                                               trie_param_t *params, int n, int cap, int *nparams)
+{
+    const char *rem = path + pos;
+    uint32_t remlen = end - pos;
+    uint32_t seglen = flat_segment(rem);
+    const struct trie_flat_node *c, *found;
+
+    c = flat_child(tf, fn, rem, seglen);
+    if (c) {
+        uint32_t b = flat_common(tf, c, rem, remlen);
+
+        if (b == c->tok_len) {
+            if (b == remlen) {
+                if (c->value != TRIE_FLAT_NONE) {
+                    *nparams = n;
+                    return c;
+                }
+            } else if ((found = flat_match(tf, c, path, pos + b + 1, end, params, n, cap, nparams))) {
+                return found;
+            }
+        }
+    }
+
+    if (fn->param && seglen > 0) {
+        c = &tf->nodes[fn->param];
+        if (n < cap) {
+            params[n].name = flat_token(tf, c) + 1;
+            params[n].off = pos;
+            params[n].len = seglen;
+        }
+
+        if (seglen == remlen) {
+            if (c->value != TRIE_FLAT_NONE) {
+                *nparams = n + 1;
+                return c;
+            }
+        } else if ((found = flat_match(tf, c, path, pos + seglen + 1, end, params, n + 1, cap, nparams))) {
+            return found;
+        }
+    }
+
+    if (fn->wild && tf->nodes[fn->wild].value != TRIE_FLAT_NONE) {
+        c = &tf->nodes[fn->wild];
+        if (n < cap) {
+            params[n].name = flat_token(tf, c) + 1;
+            params[n].off = pos;
+            params[n].len = remlen;
+        }
+        *nparams = n + 1;
+        return c;
+    }
+
+    return NULL;
+}
+
+int trie_flat_match(const trie_flat_t *tf, const char *path, trie_param_t *params, int *nparams, uint64_t *value)
+{
+    int cap = *nparams;
+    const struct trie_flat_node *fn;
+
+    *nparams = 0;
+    fn = flat_match(tf, tf->nodes, path, 1, (uint32_t)strlen(path), params, 0, cap, nparams);
+    if (fn == NULL)
+        return -1;
+
+    if (value)
+        *value = fn->value;
+    return 0;
+}
+
+#ifdef TEST_TRIE_FLAT
+
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define NROUTE 3000
+
+static uint64_t route_value(trie_node_t *node, void *arg)
+{
+    (void)arg;
+    return (uint64_t)(uintptr_t)trie_node_get_data(node);
+}
+
+static void route_path(char *buf, size_t size, int i)
+{
+    switch (i % 4) {
+    case 0:
+        snprintf(buf, size, "/api/v%d/svc%d/item%d", i % 3, i % 17, i);
+        break;
+    case 1:
+        snprintf(buf, size, "/api/v%d/svc%d", i % 3, i % 17);
+        break;
+    case 2:
+        snprintf(buf, size, "/users/:id/post%d", i % 50);
+        break;
+    default:
+        snprintf(buf, size, "/static/s%d/*path", i % 40);
+        break;
+    }
+}
+
+/* 每个路径在 trie 和快照上的精确查找、最长前缀和路由匹配结果应当一致 */
+static int compare(trie_node_t *root, const trie_flat_t *tf, const char *path)
+{
+    trie_node_t *node = trie_node_search(root, path);
+    trie_param_t p1[8], p2[8];
+    int n1 = 8, n2 = 8;
+    size_t m1 = 0, m2 = 0;
+    uint64_t v = 0;
+
+    if ((trie_flat_search(tf, path, &v) == 0) != (node != NULL) ||
+        (node && v != (trie_node_get_data(node) ? route_value(node, NULL) : TRIE_FLAT_NONE)))
+        return printf("FAIL search %s\n", path), 1;
+
+    node = trie_node_longest_prefix(root, path, &m1);
+    if ((trie_flat_longest_prefix(tf, path, &m2, &v) == 0) != (node != NULL) ||
+        (node && (m1 != m2 || v != route_value(node, NULL))))
+        return printf("FAIL longest prefix %s\n", path), 1;
+
+    node = trie_node_match(root, path, p1, &n1);
+    if ((trie_flat_match(tf, path, p2, &n2, &v) == 0) != (node != NULL))
+        return printf("FAIL match %s\n", path), 1;
+    if (node) {
+        if (v != route_value(node, NULL) || n1 != n2)
+            return printf("FAIL match value %s\n", path), 1;
+        for (int i = 0; i < n1 && i < 8; i++) {
+            if (strcmp(p1[i].name, p2[i].name) || p1[i].off != p2[i].off || p1[i].len != p2[i].len)
+                return printf("FAIL match param %d of %s\n", i, path), 1;
+        }
+    }
+
+    return 0;
+}
+
+static int round_trip(int flag, const char *file)
+{
+    trie_node_t *root = trie_node_create(flag);
+    char path[128];
+    size_t size;
+    int ret = 0;
+
+    for (int i = 0; i < NROUTE; i++) {
+        route_path(path, sizeof(path), i);
+        trie_node_t *node = trie_node_insert(root, path);
+        if (node == NULL)
+            node = trie_node_search(root, path);
+        trie_node_set_data(node, (void *)(uintptr_t)(i + 1), NULL);
+    }
+
+    void *image = trie_node_compile(root, route_value, NULL, &size);
+    if (trie_flat_write(file, image, size) != 0)
+        return printf("FAIL write %s\n", file), 1;
+    free(image);
+
+    trie_flat_t *tf = trie_flat_open(file);
+    if (tf == NULL)
+        return printf("FAIL open %s\n", file), 1;
+
+    /* 已插入的路由、它们的前缀和延长、以及参数和通配路由的请求路径 */
+    for (int i = 0; i < NROUTE && !ret; i++) {
+        route_path(path, sizeof(path), i);
+        ret |= compare(root, tf, path);
+        path[strlen(path) / 2] = '\0';
+        ret |= compare(root, tf, path);
+        snprintf(path, sizeof(path), "/api/v%d/svc%d/item%d/more", i % 4, i % 18, i);
+        ret |= compare(root, tf, path);
+        snprintf(path, sizeof(path), "/users/u%d/post%d", i, i % 60);
+        ret |= compare(root, tf, path);
+        snprintf(path, sizeof(path), "/static/s%d/css/a%d.css", i % 45, i);
+        ret |= compare(root, tf, path);
+    }
+
+    trie_flat_close(tf);
+    trie_node_delete(root);
+    return ret;
+}
+
+/* 两个进程同时反复写同一路径，最后的文件必须是完整的快照，且不留下临时文件 */
+static int concurrent_write(const char *dir, const char *file)
+{
+    trie_node_t *root = trie_node_create(0);
+    char path[64];
+    size_t size[2];
+    void *image[2];
+    int status, ret = 0;
+
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "/writer%d", i);
+        trie_node_set_data(trie_node_insert(root, path), (void *)(uintptr_t)(i + 1), NULL);
+        image[i] = trie_node_compile(root, route_value, NULL, &size[i]);
+    }
+
+    for (int w = 0; w < 2; w++) {
+        if (fork() == 0) {
+            for (int i = 0; i < 50; i++) {
+                if (trie_flat_write(file, image[w], size[w]) != 0)
+                    _exit(1);
+            }
+            _exit(0);
+        }
+    }
+    for (int w = 0; w < 2; w++) {
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ret = (printf("FAIL writer exited with %d\n", status), 1);
+    }
+
+    trie_flat_t *tf = trie_flat_open(file);
+    if (tf == NULL || trie_flat_search(tf, "/writer0", NULL) != 0)
+        ret = (printf("FAIL snapshot after concurrent writes\n"), 1);
+    trie_flat_close(tf);
+
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] != '.' && strcmp(de->d_name, "routes.flat") != 0)
+            ret = (printf("FAIL leftover %s\n", de->d_name), 1);
+    }
+    closedir(d);
+
+    free(image[0]);
+    free(image[1]);
+    trie_node_delete(root);
+    return ret;
+}
+
+int main(void)
+{
+    static const int flags[] = {0, TRIE_FLAG_RADIX, TRIE_FLAG_ARENA, TRIE_FLAG_RADIX | TRIE_FLAG_ARENA};
+    char dir[] = "/tmp/trie_flat.XXXXXX", file[64];
+    int ret = 0;
+
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    snprintf(file, sizeof(file), "%s/routes.flat", dir);
+
+    for (int f = 0; f < 4 && !ret; f++)
+        ret |= round_trip(flags[f], file);
+    if (!ret)
+        ret |= concurrent_write(dir, file);
+
+    unlink(file);
+    rmdir(dir);
+    printf("%s\n", ret ? "FAIL" : "ok");
+    return ret;
+}
+#endif /* TEST_TRIE_FLAT */
@@ -0,0 +1,148 @@
+/**
+ * @file trie_flat.h
+ * @brief trie树的只读扁平快照：不含指针，可以写入文件后mmap，多进程共享
+ *
+ * 快照布局为 头部 | 节点数组 | token数据区，全部用偏移和下标表示。
+ * 节点按广度优先顺序排列，同一节点的静态子节点连续存放并按key排序，
+ * 其后依次是参数子节点和通配子节点。相同的标签在token数据区中只存一份。
+ * 快照使用本机字节序，只能在同构的机器间共享。
+ */
+
+#ifndef TRIE_FLAT_H
+#define TRIE_FLAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trie.h"
+
+#define TRIE_FLAT_MAGIC 0x544c4654 /* "TFLT" */
+#define TRIE_FLAT_VERSION 1
+
+/**
+ * @brief 节点没有用户数据时的值
+ */
+#define TRIE_FLAT_NONE UINT64_MAX
+
+/**
+ * @brief 快照头部
+ */
+struct trie_flat_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flag;    /**< 生成快照的trie树模式 */
+    uint32_t nnode;   /**< 节点个数，0号是根节点 */
+    uint64_t toksize; /**< token数据区的字节数 */
+    uint64_t size;    /**< 整个快照的字节数 */
+};
+
+/**
+ * @brief 快照中的节点，子节点用下标表示，0 表示没有(根节点不会是子节点)
+ */
+struct trie_flat_node {
+    uint32_t tok_off; /**< 标签在token数据区中的偏移 */
+    uint32_t tok_len; /**< 标签长度 */
+    uint32_t key_len; /**< 标签第一段的长度，静态子节点按它排序 */
+    uint32_t child;   /**< 第一个静态子节点的下标 */
+    uint32_t nchild;  /**< 静态子节点个数 */
+    uint32_t param;   /**< 参数子节点下标 */
+    uint32_t wild;    /**< 通配子节点下标 */
+    uint32_t reserved;
+    uint64_t value;   /**< 用户值，没有数据时为 TRIE_FLAT_NONE */
+};
+
+/**
+ * @brief 已加载的快照
+ */
+typedef struct trie_flat trie_flat_t;
+
+/**
+ * @brief 编译快照时把节点的用户数据转换为可存储的值
+ * @param node trie树节点，只对设置了用户数据的节点调用
+ * @param arg 传递给回调函数的参数
+ * @return 存入快照的值，不能是 TRIE_FLAT_NONE
+ */
+typedef uint64_t (*trie_flat_value_fn_t)(trie_node_t *node, void *arg);
+
+/**
+ * @brief 把trie树编译成扁平快照
+ * @param root 根节点指针
+ * @param fun 用户数据转换函数，为NULL时直接保存用户数据指针的值(只在本进程内有意义)
+ * @param arg 传递给转换函数的参数
+ * @param size 输出快照的字节数
+ * @return 快照内存，由调用者用 free 释放
+ */
+void *trie_node_compile(trie_node_t *root, trie_flat_value_fn_t fun, void *arg, size_t *size);
+
+/**
+ * @brief 把快照写入文件，先在同一目录写唯一命名的临时文件并fsync，再rename并fsync目录，
+ *        读者不会看到写了一半的文件，多个写者并发写同一路径时最后rename的生效
+ * @param path 文件路径
+ * @param image 快照内存
+ * @param size 快照字节数
+ * @return 成功返回0，失败返回-1
+ */
+int trie_flat_write(const char *path, const void *image, size_t size);
+
+/**
+ * @brief 以只读方式mmap快照文件
+ * @param path 文件路径
+ * @return 快照指针，文件不存在或格式错误时返回NULL
+ */
+trie_flat_t *trie_flat_open(const char *path);
+
+/**
+ * @brief 在一块内存上使用快照，内存需要在快照关闭前一直有效
+ * @param image 快照内存
+ * @param size 快照字节数
+ * @return 快照指针，格式错误时返回NULL
+ */
+trie_flat_t *trie_flat_attach(const void *image, size_t size);
+
+/**
+ * @brief 关闭快照，解除文件映射
+ * @param tf 快照指针
+ */
+void trie_flat_close(trie_flat_t *tf);
+
+/**
+ * @brief 原子地替换当前使用的快照，用于热加载
+ *        旧快照可能仍有读者在使用，需要调用者确认没有读者后再关闭
+ * @param slot 保存当前快照指针的位置
+ * @param next 新快照
+ * @return 被替换下来的旧快照
+ */
+trie_flat_t *trie_flat_swap(trie_flat_t **slot, trie_flat_t *next);
+
+/**
+ * @brief 精确查找路径
+ * @param tf 快照指针
+ * @param path 待查找的路径
+ * @param value 输出节点的用户值，可以为NULL
+ * @return 找到返回0，否则返回-1
+ */
+int trie_flat_search(const trie_flat_t *tf, const char *path, uint64_t *value);
+
+/**
+ * @brief 最长前缀匹配，语义同 trie_node_longest_prefix
+ * @param tf 快照指针
+ * @param path 待查找的路径
+ * @param matched_len 输出匹配的路径前缀长度
+ * @param value 输出节点的用户值，可以为NULL
+ * @return 找到返回0，否则返回-1
+ */
+int trie_flat_longest_prefix(const trie_flat_t *tf, const char *path, size_t *matched_len, uint64_t *value);
+
+/**
+ * @brief 按路由规则匹配请求路径，语义同 trie_node_match，
+ *        参数名指向快照内的token数据区
+ * @param tf 快照指针
+ * @param path 请求路径
+ * @param params 保存捕获参数的数组
+ * @param nparams 输入为params的容量，输出为捕获的参数个数
+ * @param value 输出节点的用户值，可以为NULL
+ * @return 匹配成功返回0，否则返回-1
+ */
+int trie_flat_match(const trie_flat_t *tf, const char *path, trie_param_t *params, int *nparams, uint64_t *value);
+
+#endif /* TRIE_FLAT_H */